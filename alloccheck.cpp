@@ -0,0 +1,128 @@
+#include "alloccheck.h"
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <errno.h>
+
+// allocations are counted only while check_allocations runs, the hooks exist only in the check build
+static atomic<bool> counting(false);
+static atomic<long long> allocations(0);
+
+static inline void count_allocation()
+{
+    if(counting.load(memory_order_relaxed))
+        allocations.fetch_add(1, memory_order_relaxed);
+}
+
+#ifdef __GLIBC__
+// malloc of the executable interposes the one of libc for OpenCV and libstdc++ too,
+// so cv::fastMalloc and operator new are both counted here
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+
+extern "C" void *malloc(size_t size) __THROW
+{
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) __THROW
+{
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *p, size_t size) __THROW
+{
+    count_allocation();
+    return __libc_realloc(p, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size) __THROW
+{
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **p, size_t alignment, size_t size) __THROW
+{
+    count_allocation();
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+
+bool malloc_counted()
+{
+    return true;
+}
+#else
+// C runtime of other platforms cannot be interposed, operator new is replaced instead
+void *operator new(size_t size)
+{
+    count_allocation();
+    void *p = malloc(size ? size : 1);
+    if(!p)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+bool malloc_counted()
+{
+    return false;
+}
+#endif
+
+int check_allocations(const Recognizer &model, const vector<Mat> &faces, function<void(const string&)> report)
+{
+    if(model.labels.size() <= Recognizer::K || faces.empty())
+    {
+        report("Error: no model or faces for allocation check");
+        return 1;
+    }
+
+    // first pass sizes every buffer of scratch
+    RecognizeScratch scratch;
+    for(unsigned int i = 0; i < faces.size(); i++)
+        model.recognize_id(faces[i], scratch);
+    const uchar *buffers[3] = { scratch.gray.data, scratch.row.data, scratch.projected.data };
+    const Weight *votes = scratch.votes.data();
+    const pair<double, unsigned int> *order = scratch.order.data();
+
+    allocations.store(0);
+    counting.store(true);
+    for(unsigned int i = 0; i < faces.size(); i++)
+        model.recognize_id(faces[i], scratch);
+    counting.store(false);
+    long long counted = allocations.load();
+
+    // scratch buffers have to stay where they were, whatever allocator is behind them
+    const uchar *after[3] = { scratch.gray.data, scratch.row.data, scratch.projected.data };
+    int moved = 0;
+    for(int b = 0; b < 3; b++)
+        moved += buffers[b] != after[b];
+    moved += votes != scratch.votes.data();
+    moved += order != scratch.order.data();
+
+    report("recognize_id on warm scratch: "+to_string(faces.size())+" faces, "+to_string(counted)
+           +(malloc_counted() ? " heap allocations (malloc level)" : " operator new calls (malloc is not counted on this platform)")
+           +", "+to_string(moved)+" scratch buffers reallocated");
+    return counted > 0 || moved > 0 ? 1 : 0;
+}
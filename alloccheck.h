@@ -0,0 +1,23 @@
+#ifndef ALLOCCHECK_H
+#define ALLOCCHECK_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "recognizer.h"
+
+using namespace std;
+
+/**
+ * true if every malloc of the process is counted, including cv::fastMalloc of OpenCV,
+ * otherwise only operator new is counted and Mat buffers are checked by their addresses
+ */
+bool malloc_counted();
+/**
+ * count heap allocations of recognize_id with warm scratch buffers, returns non-zero if there are any
+ * available only in the check build, qmake CONFIG+=alloc_check
+ */
+int check_allocations(const Recognizer &model, const vector<Mat> &faces, function<void(const string&)> report);
+
+#endif // ALLOCCHECK_H
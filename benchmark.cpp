@@ -0,0 +1,764 @@
+#include "benchmark.h"
+#include "preprocessimg.h"
+#include "multistream.h"
+#include "histogram.h"
+#include "tiered.h"
+#include "shard.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <math.h>
+#include <time.h>
+#include <atomic>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+#ifdef Q_OS_WIN
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max are used below
+#endif
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+vector<string> csv_paths(const string &filename, char separator)
+{
+    ifstream file(filename.c_str(), ifstream::in);
+    if (!file) {
+        string error_message = "No valid input file was given, please check the given filename.";
+        CV_Error(CV_StsBadArg, error_message);
+    }
+    vector<string> paths;
+    string line, path;
+    while (getline(file, line)) {
+        stringstream liness(line);
+        getline(liness, path, separator);
+        if(!path.empty())
+            paths.push_back(path);
+    }
+    return paths;
+}
+
+int bench_detectors(const string &csvPath, const vector<string> &cascades, function<void(const string&)> report)
+{
+    vector<string> paths;
+    try
+    {
+        paths = csv_paths(csvPath);
+    }
+    catch (Exception& e)
+    {
+        report("Error opening file \""+csvPath+"\". Reason: " + e.msg);
+        return 1;
+    }
+
+    // frames are loaded and equalized once, only the cascade is timed
+    vector<Mat> frames;
+    for(unsigned int i = 0; i < paths.size(); i++)
+    {
+        Mat m = imread(paths[i], 1);
+        if(m.empty())
+            continue;
+        PreprocessImg img(m);
+        Mat gray;
+        img.equalize(img.imgOrig, gray, false);
+        frames.push_back(gray);
+    }
+    if(frames.empty())
+    {
+        report("Error: no images to benchmark in "+csvPath);
+        return 1;
+    }
+    report("Benchmarking "+to_string(cascades.size())+" detectors on "+to_string(frames.size())+" images from "+csvPath);
+
+    int haar = 0, lbp = 0;
+    for(unsigned int c = 0; c < cascades.size(); c++)
+    {
+        CascadeClassifier cascade;
+        if(!cascade.load(cascades[c]))
+        {
+            report("Skipping "+cascades[c]+": cannot load cascade");
+            continue;
+        }
+        if(cascades[c].find("lbpcascade") != string::npos)
+            lbp++;
+        else
+            haar++;
+
+        int detected = 0;
+        int64 ticks = 0;
+        for(unsigned int i = 0; i < frames.size(); i++)
+        {
+            vector<Rect> faces;
+            int64 start = getTickCount();
+            PreprocessImg::detectFaces(cascade, frames[i], faces);
+            ticks += getTickCount() - start;
+            if(!faces.empty())
+                detected++;
+        }
+
+        double ms = ticks * 1000.0 / getTickFrequency() / frames.size();
+        report(cascades[c]+": "+to_string(ms)+" ms/frame, detected "+to_string(detected)+"/"+to_string(frames.size())
+               +" => "+to_string(100.0 * detected / frames.size())+"%");
+    }
+
+    // comparison is the point of the benchmark, a single family of detectors is an error
+    if(haar == 0 || lbp == 0)
+    {
+        report("Error: need at least one Haar and one LBP cascade, e.g. bundled lbpcascade_frontalface.xml");
+        return 1;
+    }
+    return 0;
+}
+
+// same neighbours in the same order, distances equal up to float rounding
+static bool same_neighbours(const vector<Neighbour> &a, const vector<Neighbour> &b)
+{
+    if(a.size() != b.size())
+        return false;
+    for(unsigned int i = 0; i < a.size(); i++)
+    {
+        if(a[i].label != b[i].label || fabs(a[i].distance - b[i].distance) > 1e-4 * max(1.0, a[i].distance))
+            return false;
+    }
+    return true;
+}
+
+int bench_knn(const Recognizer &model, const vector<Mat> &faces, function<void(const string&)> report)
+{
+    if(model.matProjections.empty() || faces.empty())
+    {
+        report("Error: no model or faces for KNN benchmark");
+        return 1;
+    }
+    Mat targets = model.project(faces);
+    const int dims = model.matProjections.cols;
+    const int rows = model.matProjections.rows;
+
+    // reference: full distance to every gallery entry
+    vector< vector<Neighbour> > exact(targets.rows);
+    int64 start = getTickCount();
+    for(int i = 0; i < targets.rows; i++)
+        model.nearest_exact(targets.row(i), Recognizer::K, exact[i]);
+    double exactUs = (getTickCount() - start) * 1e6 / getTickFrequency() / targets.rows;
+    report("KNN on "+to_string(rows)+" entries x "+to_string(dims)+" components, "+to_string(targets.rows)+" queries");
+    report("  full distance: "+to_string(exactUs)+" us/query");
+
+    // early abandon alone and with coarse pre-filter over leading components
+    int coarse[2] = { 0, model.coarseDims > 0 ? model.coarseDims : min(Recognizer::BLOCK, dims) };
+    int totalMismatches = 0;
+    for(int c = 0; c < 2; c++)
+    {
+        Recognizer variant(model);
+        variant.coarseDims = coarse[c];
+        KnnStats stats;
+        int mismatches = 0;
+        vector<Neighbour> neighbours;
+        start = getTickCount();
+        for(int i = 0; i < targets.rows; i++)
+        {
+            variant.nearest(targets.row(i), Recognizer::K, neighbours, &stats);
+            if(!same_neighbours(neighbours, exact[i]))
+                mismatches++;
+        }
+        double us = (getTickCount() - start) * 1e6 / getTickFrequency() / targets.rows;
+        report("  early abandon"+(coarse[c] > 0 ? " + coarse pass over "+to_string(coarse[c])+" components" : string(""))+": "
+               +to_string(us)+" us/query => speedup "+to_string(exactUs / us)
+               +", "+to_string(stats.dims / (double)stats.queries / rows)+" of "+to_string(dims)+" components per entry"
+               +", "+to_string(100.0 * stats.entries / stats.queries / rows)+"% entries visited"
+               +", "+to_string(mismatches)+" results differ");
+        totalMismatches += mismatches;
+    }
+
+    // whole recognition: reference path (subspaceProject, label vote over map) against reused scratch buffers
+    int differ = 0;
+    start = getTickCount();
+    for(unsigned int i = 0; i < faces.size(); i++)
+        model.recognize_reference(faces[i]);
+    double allocUs = (getTickCount() - start) * 1e6 / getTickFrequency() / faces.size();
+    RecognizeScratch scratch;
+    model.recognize_id(faces[0], scratch); // warm up buffers
+    start = getTickCount();
+    for(unsigned int i = 0; i < faces.size(); i++)
+        model.recognize_id(faces[i], scratch);
+    double scratchUs = (getTickCount() - start) * 1e6 / getTickFrequency() / faces.size();
+    for(unsigned int i = 0; i < faces.size(); i++)
+    {
+        if(model.name(model.recognize_id(faces[i], scratch)) != model.recognize_reference(faces[i]))
+            differ++;
+    }
+    report("  reference recognize: "+to_string(allocUs)+" us/face, recognize_id with scratch buffers: "+to_string(scratchUs)
+           +" us/face => speedup "+to_string(allocUs / scratchUs)+", "+to_string(differ)+" results differ");
+
+    // fast paths are meant to be exact, any difference is a bug
+    if(totalMismatches > 0 || differ > 0)
+    {
+        report("Error: fast KNN or recognition differs from reference");
+        return 1;
+    }
+    return 0;
+}
+
+// process video frames like camera input, returns CPU seconds spent
+static double process_video(const string &videoPath, const Recognizer &model, FrameGate *gate, long long &frames)
+{
+    VideoCapture video(videoPath);
+    frames = 0;
+    clock_t start = clock();
+    Mat frame;
+    RecognizeScratch scratch;
+    while(video.read(frame))
+    {
+        frames++;
+        if(gate && gate->check(frame) != FrameGate::PASS)
+            continue;
+        PreprocessImg img(frame);
+        if(img.preprocess())
+            continue;
+        if(gate && gate->checkFace(img.faceRect) != FrameGate::PASS)
+            continue;
+        model.recognize_id(img.imgPreprocessedFace, scratch);
+    }
+    return (clock() - start) / (double)CLOCKS_PER_SEC;
+}
+
+int bench_gate(const string &videoPath, const Recognizer &model, FrameGate &gate, function<void(const string&)> report)
+{
+    if(!VideoCapture(videoPath).isOpened())
+    {
+        report("Error: cannot open video "+videoPath);
+        return 1;
+    }
+
+    long long frames = 0;
+    double ungated = process_video(videoPath, model, 0, frames);
+    if(frames == 0)
+    {
+        report("Error: no frames in "+videoPath);
+        return 1;
+    }
+    report("Without gate: "+to_string(frames)+" frames, "+to_string(ungated * 1000.0 / frames)+" ms CPU/frame");
+
+    gate.reset();
+    double gated = process_video(videoPath, model, &gate, frames);
+    report("With gate: "+to_string(gated * 1000.0 / frames)+" ms CPU/frame => "+to_string(100.0 * (1.0 - gated / ungated))+"% CPU saved");
+    report("Gated frames: static "+to_string(gate.staticFrames)+", blurred "+to_string(gate.blurredFrames)
+           +", small face "+to_string(gate.smallFaces)+" of "+to_string(gate.frames));
+    return 0;
+}
+
+int bench_streams(const string &videoPath, shared_ptr<const Recognizer> model, int maxStreams, int seconds,
+                  function<void(const string&)> report)
+{
+    if(!VideoCapture(videoPath).isOpened())
+    {
+        report("Error: cannot open video "+videoPath);
+        return 1;
+    }
+
+    double single = 0.0;
+    for(int n = 1; n <= maxStreams; n *= 2)
+    {
+        StreamProcessor processor(model, QThread::idealThreadCount());
+        for(int s = 0; s < n; s++)
+            processor.addStream(videoPath);
+        processor.run(seconds);
+        processor.report(report);
+
+        double fps = processor.throughput();
+        if(n == 1)
+            single = fps;
+        report(to_string(n)+" streams: "+to_string(fps)+" fps total, "+to_string(fps / n)+" fps per stream, "
+               +to_string(single > 0.0 ? fps / single : 0.0)+"x single stream");
+    }
+    return 0;
+}
+
+// resident set size of this process (working set on Windows), -1 where it is not known
+static long long resident_bytes()
+{
+#if defined(Q_OS_LINUX)
+    ifstream statm("/proc/self/statm");
+    long long pages, resident;
+    if(statm >> pages >> resident)
+        return resident * sysconf(_SC_PAGESIZE);
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.WorkingSetSize;
+#endif
+    return -1;
+}
+
+static string megabytes(long long bytes)
+{
+    return bytes < 0 ? string("n/a") : to_string(bytes / (1024.0 * 1024.0))+" MB";
+}
+
+// every step-th query face starting at first
+class QueryRunner : public QRunnable
+{
+public:
+    QueryRunner(const Recognizer &model, const vector<Mat> &faces, int first, int step) :
+        model(model), faces(faces), first(first), step(step) {}
+
+    void run()
+    {
+        RecognizeScratch scratch;
+        for(unsigned int i = this->first; i < this->faces.size(); i += this->step)
+            this->model.recognize_id(this->faces[i], scratch);
+    }
+
+private:
+    const Recognizer &model;
+    const vector<Mat> &faces;
+    int first;
+    int step;
+};
+
+int bench_scaling(const Recognizer &base, SynthMode mode, const vector<int> &sizes, int dims, const vector<Mat> &faces,
+                  const string &tablePath, function<void(const string&)> report)
+{
+    if(base.matProjections.empty() || faces.empty())
+    {
+        report("Error: no model or faces for scaling benchmark");
+        return 1;
+    }
+
+    // 1, 2, 4 ... threads up to number of cores
+    vector<int> threads;
+    for(int t = 1; t < QThread::idealThreadCount(); t *= 2)
+        threads.push_back(t);
+    threads.push_back(max(1, QThread::idealThreadCount()));
+
+    string header = "mode;entries;dims;build ms;RSS increase MB;p50 us;p99 us";
+    for(unsigned int t = 0; t < threads.size(); t++)
+        header += ";qps "+to_string(threads[t])+" thr";
+    report(header);
+
+    QFile table(QString::fromStdString(tablePath));
+    if(!tablePath.empty())
+    {
+        if(!table.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        {
+            report("Error: cannot write "+tablePath);
+            return 1;
+        }
+        if(table.size() == 0)
+            table.write((header+"\n").c_str());
+    }
+
+    for(unsigned int s = 0; s < sizes.size(); s++)
+    {
+        Recognizer model;
+        long long residentBefore = resident_bytes();
+        int64 start = getTickCount();
+        synth_gallery(base, mode, sizes[s], 10, dims, 42 + s, model);
+        double buildMs = (getTickCount() - start) * 1000.0 / getTickFrequency();
+        long long residentAfter = resident_bytes();
+        string memory = residentBefore < 0 || residentAfter < 0 ? string("n/a")
+                        : to_string((residentAfter - residentBefore) / (1024.0 * 1024.0));
+
+        // latency of single queries on one thread
+        LatencyHistogram latency;
+        QElapsedTimer clock;
+        RecognizeScratch scratch;
+        for(unsigned int i = 0; i < faces.size(); i++)
+        {
+            clock.start();
+            model.recognize_id(faces[i], scratch);
+            latency.record(clock.nsecsElapsed() / 1000);
+        }
+
+        string row = string(mode == SYNTH_PERTURBED ? "perturbed" : "random")+";"+to_string(model.matProjections.rows)
+                     +";"+to_string(model.matProjections.cols)+";"+to_string(buildMs)
+                     +";"+memory
+                     +";"+to_string(latency.percentile(0.5))+";"+to_string(latency.percentile(0.99));
+
+        // throughput of all queries spread over pool threads
+        for(unsigned int t = 0; t < threads.size(); t++)
+        {
+            QThreadPool pool;
+            pool.setMaxThreadCount(threads[t]);
+            clock.start();
+            for(int r = 0; r < threads[t]; r++)
+                pool.start(new QueryRunner(model, faces, r, threads[t]));
+            pool.waitForDone();
+            row += ";"+to_string(faces.size() * 1e9 / max(clock.nsecsElapsed(), (qint64)1));
+        }
+
+        report(row);
+        if(table.isOpen())
+            table.write((row+"\n").c_str());
+    }
+    return 0;
+}
+
+int bench_tiered(Recognizer &model, const vector<double> &budgets, int queries, double skew,
+                 function<void(const string&)> report)
+{
+    if(model.matProjections.empty() || model.names.empty() || queries <= 0)
+    {
+        report("Error: no gallery for tiered benchmark");
+        return 1;
+    }
+    const int dims = model.matProjections.cols;
+    const size_t galleryBytes = model.matProjections.total() * sizeof(float);
+
+    // identities in random order, rank r is asked with probability proportional to 1/r^skew
+    RNG rng(7);
+    vector< vector<unsigned int> > rowsOf(model.names.size());
+    for(unsigned int i = 0; i < model.labelIds.size(); i++)
+        rowsOf[model.labelIds[i]].push_back(i);
+    vector<int> rank(model.names.size());
+    for(unsigned int i = 0; i < rank.size(); i++)
+        rank[i] = i;
+    for(unsigned int i = rank.size() - 1; i > 0; i--)
+        swap(rank[i], rank[rng.uniform(0, (int)i + 1)]);
+    vector<double> cdf(rank.size());
+    double total = 0.0;
+    for(unsigned int r = 0; r < cdf.size(); r++)
+    {
+        total += 1.0 / pow(r + 1.0, skew);
+        cdf[r] = total;
+    }
+
+    // query is a gallery row of chosen identity with noise of 0.2 standard deviation per component
+    Mat sigma = Mat::zeros(1, dims, CV_32FC1);
+    if(model.eugenVal.total() >= (size_t)dims)
+    {
+        for(int d = 0; d < dims; d++)
+            sigma.at<float>(0, d) = 0.2f * (float)sqrt(max(0.0, (double)model.eugenVal.at<float>(d)));
+    }
+    Mat targets(queries, dims, CV_32FC1);
+    Mat noise(1, dims, CV_32FC1);
+    for(int i = 0; i < queries; i++)
+    {
+        int r = lower_bound(cdf.begin(), cdf.end(), rng.uniform(0.0, total)) - cdf.begin();
+        const vector<unsigned int> &rows = rowsOf[rank[min(r, (int)rank.size() - 1)]];
+        rng.fill(noise, RNG::NORMAL, 0.0, 1.0);
+        Mat target = targets.row(i);
+        target = model.matProjections.row(rows[rng.uniform(0, (int)rows.size())]) + noise.mul(sigma);
+    }
+
+    // reference: every row in RAM
+    vector< vector<Neighbour> > reference(queries);
+    LatencyHistogram latency;
+    QElapsedTimer clock;
+    for(int i = 0; i < queries; i++)
+    {
+        clock.start();
+        model.nearest(targets.row(i), Recognizer::K, reference[i]);
+        latency.record(clock.nsecsElapsed() / 1000);
+    }
+    report("Gallery "+to_string(model.matProjections.rows)+" entries x "+to_string(dims)+" components, "
+           +to_string(model.names.size())+" identities, "+to_string(queries)+" queries, Zipf skew "+to_string(skew));
+    report("  all in RAM: resident "+megabytes(resident_bytes())+", p50 < "+to_string(latency.percentile(0.5))
+           +" us, p99 < "+to_string(latency.percentile(0.99))+" us");
+
+    TieredGallery tiered;
+    string path = QDir::temp().filePath(QString("pov-tiered-%1.bin").arg(QCoreApplication::applicationPid())).toStdString();
+    if(tiered.build(model, path, 0))
+    {
+        report("Error: cannot write "+path);
+        return 1;
+    }
+    vector<Mat>().swap(model.projections);
+    model.matProjections = Mat();
+    report("  gallery moved to "+path+", resident "+megabytes(resident_bytes())+", cold read-ahead: "+TieredGallery::readAhead());
+
+    for(unsigned int b = 0; b < budgets.size(); b++)
+    {
+        tiered.reset();
+        tiered.setBudget((size_t)(budgets[b] * galleryBytes));
+        vector<Neighbour> neighbours;
+        for(int i = 0; i < queries; i++) // warm up access statistics
+            tiered.nearest(targets.row(i), Recognizer::K, neighbours);
+
+        latency.clear();
+        int mismatches = 0;
+        long long coldBefore = tiered.coldRows();
+        for(int i = 0; i < queries; i++)
+        {
+            clock.start();
+            tiered.nearest(targets.row(i), Recognizer::K, neighbours);
+            latency.record(clock.nsecsElapsed() / 1000);
+            if(!same_neighbours(neighbours, reference[i]))
+                mismatches++;
+        }
+        report("  budget "+to_string(100.0 * budgets[b])+"% ("+megabytes(tiered.hotBytes())+", "+to_string(tiered.hotIdentities())
+               +" hot identities): resident "+megabytes(resident_bytes())+", p50 < "+to_string(latency.percentile(0.5))
+               +" us, p99 < "+to_string(latency.percentile(0.99))+" us, "
+               +to_string((tiered.coldRows() - coldBefore) / (double)queries)+" cold rows/query, "
+               +to_string(mismatches)+" results differ");
+    }
+    return 0;
+}
+
+// faces of found which overlap some face of reference by more than half of their union
+static int matched_faces(const vector<Rect> &reference, const vector<Rect> &found)
+{
+    int matched = 0;
+    for(unsigned int i = 0; i < reference.size(); i++)
+    {
+        for(unsigned int j = 0; j < found.size(); j++)
+        {
+            double common = (reference[i] & found[j]).area();
+            if(common > 0.5 * (reference[i].area() + found[j].area() - common))
+            {
+                matched++;
+                break;
+            }
+        }
+    }
+    return matched;
+}
+
+int bench_tiles(const string &imagePath, int maxFace, int repeats, function<void(const string&)> report)
+{
+    Mat image = imread(imagePath, 1);
+    if(image.empty())
+    {
+        report("Error: cannot load image "+imagePath);
+        return 1;
+    }
+    if(PreprocessImg::loadCascades())
+    {
+        report("Error: loading cascade files");
+        return 1;
+    }
+    repeats = max(repeats, 1);
+    PreprocessImg img(image);
+    Mat gray;
+    img.equalize(img.imgOrig, gray, false);
+
+    CascadeClassifier cascade;
+    cascade.load(PreprocessImg::faceCascade());
+    vector<Rect> reference;
+    int64 start = getTickCount();
+    for(int r = 0; r < repeats; r++)
+        PreprocessImg::detectAllFaces(cascade, gray, maxFace, reference);
+    double wholeMs = (getTickCount() - start) * 1000.0 / getTickFrequency() / repeats;
+    report(to_string(gray.cols)+"x"+to_string(gray.rows)+", faces up to "+to_string(maxFace)+" px, whole frame: "
+           +to_string(wholeMs)+" ms, "+to_string(reference.size())+" faces");
+
+    int cores = QThread::idealThreadCount();
+    vector<int> threads;
+    for(int t = 1; t < cores; t *= 2)
+        threads.push_back(t);
+    threads.push_back(max(1, cores));
+    for(unsigned int t = 0; t < threads.size(); t++)
+    {
+        QThreadPool::globalInstance()->setMaxThreadCount(threads[t]);
+        vector<Rect> faces;
+        PreprocessImg::detectFacesTiled(gray, maxFace, faces); // load cascades of pool threads
+        start = getTickCount();
+        for(int r = 0; r < repeats; r++)
+            PreprocessImg::detectFacesTiled(gray, maxFace, faces);
+        double ms = (getTickCount() - start) * 1000.0 / getTickFrequency() / repeats;
+        report("  tiled on "+to_string(threads[t])+" threads: "+to_string(ms)+" ms => speedup "+to_string(wholeMs / ms)
+               +", "+to_string(faces.size())+" faces, "+to_string(matched_faces(reference, faces))+"/"+to_string(reference.size())
+               +" whole frame faces matched");
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(cores);
+    return 0;
+}
+
+// size mismatch of gallery arrays, empty string if model is consistent
+static string inconsistency(const Recognizer &model)
+{
+    size_t n = model.labels.size();
+    if(model.labelIds.size() != n)
+        return "labelIds "+to_string(model.labelIds.size())+" for "+to_string(n)+" labels";
+    if((size_t)model.matProjections.rows != n)
+        return "matProjections "+to_string(model.matProjections.rows)+" rows for "+to_string(n)+" labels";
+    if(!model.weights.empty() && model.weights.size() != n)
+        return "weights "+to_string(model.weights.size())+" for "+to_string(n)+" labels";
+    for(size_t i = 0; i < n; i++)
+        if(model.labelIds[i] < 0 || (size_t)model.labelIds[i] >= model.names.size())
+            return "label id "+to_string(model.labelIds[i])+" out of "+to_string(model.names.size())+" names";
+    return string();
+}
+
+class SwapReader : public QRunnable
+{
+public:
+    SwapReader(const shared_ptr<const Recognizer> &current, const vector<Mat> &faces, const atomic<bool> &stop, int first) :
+        current(current), faces(faces), stop(stop), first(first), reads(0), errors(0) {}
+
+    void run()
+    {
+        RecognizeScratch scratch;
+        for(unsigned int i = this->first; !this->stop.load(); i++)
+        {
+            // same as MainWindow::snapshot
+            shared_ptr<const Recognizer> model = atomic_load(&this->current);
+            string error = inconsistency(*model);
+            int id = model->recognize_id(this->faces[i % this->faces.size()], scratch);
+            if(error.empty() && id >= (int)model->names.size())
+                error = "recognized id "+to_string(id)+" out of "+to_string(model->names.size())+" names";
+            if(!error.empty())
+            {
+                if(this->errors == 0)
+                    this->firstError = error;
+                this->errors++;
+            }
+            this->reads++;
+        }
+    }
+
+    long long reads; /** */
+    long long errors; /** inconsistent snapshots seen */
+    string firstError; /** */
+
+private:
+    const shared_ptr<const Recognizer> &current;
+    const vector<Mat> &faces;
+    const atomic<bool> &stop;
+    int first;
+};
+
+int stress_swap(const vector<Mat> &faces, const vector<string> &labels, int readers, int seconds, int prototypes,
+                function<void(const string&)> report)
+{
+    if(faces.size() <= Recognizer::K)
+    {
+        report("Error: not enough faces for swap stress test");
+        return 1;
+    }
+
+    // every face in one of five folds, training without one fold changes gallery size and names
+    const int folds = 5;
+    vector<int> groups(faces.size());
+    for(unsigned int i = 0; i < faces.size(); i++)
+        groups[i] = i % folds;
+
+    shared_ptr<Recognizer> trained = make_shared<Recognizer>();
+    trained->train(faces, labels, groups, -1);
+    shared_ptr<const Recognizer> current = trained;
+
+    atomic<bool> stop(false);
+    QThreadPool pool;
+    pool.setMaxThreadCount(readers);
+    vector<SwapReader*> runners;
+    for(int r = 0; r < readers; r++)
+    {
+        runners.push_back(new SwapReader(current, faces, stop, r));
+        runners.back()->setAutoDelete(false);
+        pool.start(runners.back());
+    }
+
+    // writer alternates freshly trained and compacted models, like training_finished
+    long long published = 0;
+    QElapsedTimer clock;
+    clock.start();
+    for(int round = 0; clock.elapsed() < seconds * 1000LL; round++)
+    {
+        int testGroup = round % (folds + 1) == folds ? -1 : round % (folds + 1);
+        shared_ptr<Recognizer> next = make_shared<Recognizer>();
+        next->train(faces, labels, groups, testGroup);
+        atomic_store(&current, shared_ptr<const Recognizer>(next));
+        published++;
+
+        shared_ptr<Recognizer> compacted = make_shared<Recognizer>(*next);
+        compacted->compact(prototypes);
+        atomic_store(&current, shared_ptr<const Recognizer>(compacted));
+        published++;
+    }
+    stop.store(true);
+    pool.waitForDone();
+
+    long long reads = 0, errors = 0;
+    string firstError;
+    for(unsigned int r = 0; r < runners.size(); r++)
+    {
+        reads += runners[r]->reads;
+        errors += runners[r]->errors;
+        if(firstError.empty())
+            firstError = runners[r]->firstError;
+        delete runners[r];
+    }
+
+    report(to_string(published)+" models published, "+to_string(reads)+" reads by "+to_string(readers)+" threads, "
+           +to_string(errors)+" inconsistent snapshots");
+    if(errors > 0)
+        report("Error: "+firstError);
+    return errors > 0 || reads == 0 ? 1 : 0;
+}
+
+int bench_shards(const Recognizer &model, const vector<Mat> &faces, int shards, int timeoutMs,
+                 function<void(const string&)> report)
+{
+    if(model.labels.size() <= Recognizer::K || faces.empty() || shards < 2)
+    {
+        report("Error: no model or faces for shard benchmark, or less than 2 shards");
+        return 1;
+    }
+
+    ShardCoordinator coordinator;
+    if(coordinator.start(model, shards, ShardCoordinator::BY_IDENTITY, timeoutMs) || !coordinator.wait_ready(10000))
+    {
+        report("Error: cannot start gallery shards");
+        return 1;
+    }
+
+    // scatter-gather has to give the same votes as the in-process gallery
+    RecognizeScratch scratch;
+    vector<Mat> projected(faces.size());
+    vector<string> expected(faces.size());
+    int64 localTicks = 0, shardTicks = 0;
+    for(unsigned int i = 0; i < faces.size(); i++)
+    {
+        projected[i] = model.project(faces[i]);
+        int64 start = getTickCount();
+        expected[i] = model.name(model.recognize_id(faces[i], scratch));
+        localTicks += getTickCount() - start;
+    }
+
+    int differ = 0, incomplete = 0;
+    vector<Neighbour> neighbours;
+    for(unsigned int i = 0; i < faces.size(); i++)
+    {
+        int64 start = getTickCount();
+        coordinator.nearest(projected[i], Recognizer::K, neighbours);
+        string label = Recognizer::vote(neighbours);
+        shardTicks += getTickCount() - start;
+        differ += label != expected[i];
+        incomplete += coordinator.answered() != coordinator.shardCount();
+    }
+    double frequency = getTickFrequency() / 1e6;
+    report(to_string(shards)+" shards: "+to_string(differ)+"/"+to_string(faces.size())+" votes differ from local gallery, "
+           +to_string(incomplete)+" queries with missing shards, local "+to_string(localTicks / frequency / faces.size())
+           +" us/face, sharded "+to_string(shardTicks / frequency / faces.size())+" us/face (without projection)");
+
+    // with one worker gone every query has to end within timeout and still vote over the other shards
+    coordinator.kill_worker(shards - 1);
+    int wrongAnswered = 0, empty = 0;
+    double slowest = 0.0;
+    for(unsigned int i = 0; i < faces.size(); i++)
+    {
+        QElapsedTimer clock;
+        clock.start();
+        coordinator.nearest(projected[i], Recognizer::K, neighbours);
+        slowest = max(slowest, clock.nsecsElapsed() / 1e6);
+        wrongAnswered += coordinator.answered() != shards - 1;
+        empty += neighbours.empty();
+    }
+    report("One shard killed: "+to_string(wrongAnswered)+" queries not answered by exactly "+to_string(shards - 1)+" shards, "
+           +to_string(empty)+" without neighbours, slowest query "+to_string(slowest)+" ms with timeout "+to_string(timeoutMs)+" ms");
+
+    // slack covers scheduling of the surviving workers
+    bool failed = differ > 0 || incomplete > 0 || wrongAnswered > 0 || empty > 0 || slowest > timeoutMs + 100;
+    if(failed)
+        report("Error: sharded search does not match local gallery or missing shard is not handled");
+    return failed ? 1 : 0;
+}
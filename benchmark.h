@@ -0,0 +1,66 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "recognizer.h"
+#include "framegate.h"
+#include "synthetic.h"
+
+using namespace std;
+
+/**
+ * paths of images listed in csv file
+ */
+vector<string> csv_paths(const string &filename, char separator = ';');
+/**
+ * per-frame detection time and detection rate of every face cascade on images of csv file, returns 0 on success
+ */
+int bench_detectors(const string &csvPath, const vector<string> &cascades, function<void(const string&)> report);
+/**
+ * compare early abandoning KNN with and without coarse pass against full distance KNN on preprocessed faces,
+ * returns non-zero if any result differs
+ */
+int bench_knn(const Recognizer &model, const vector<Mat> &faces, function<void(const string&)> report);
+/**
+ * CPU time per frame of detection and recognition on recorded video, without and with frame gate
+ */
+int bench_gate(const string &videoPath, const Recognizer &model, FrameGate &gate, function<void(const string&)> report);
+/**
+ * aggregate and per-stream fps of 1, 2, 4 ... maxStreams copies of recorded video sharing one model and thread pool
+ */
+int bench_streams(const string &videoPath, shared_ptr<const Recognizer> model, int maxStreams, int seconds,
+                  function<void(const string&)> report);
+/**
+ * build time, memory, recognition latency and QPS over thread counts on synthetic galleries of given sizes
+ * one table row per size, rows are appended to tablePath as csv unless it is empty
+ */
+int bench_scaling(const Recognizer &base, SynthMode mode, const vector<int> &sizes, int dims, const vector<Mat> &faces,
+                  const string &tablePath, function<void(const string&)> report);
+/**
+ * exact tiered gallery against all-in-RAM KNN under Zipf skewed queries, for RAM budgets given as fraction of gallery
+ * gallery rows of model are released after reference pass, so resident memory then shows tiered store only
+ */
+int bench_tiered(Recognizer &model, const vector<double> &budgets, int queries, double skew,
+                 function<void(const string&)> report);
+/**
+ * whole frame against tiled face detection on large image, over 1, 2, 4 ... cores pool threads
+ */
+int bench_tiles(const string &imagePath, int maxFace, int repeats, function<void(const string&)> report);
+/**
+ * readers recognize on snapshots while one thread publishes retrained and compacted models,
+ * returns non-zero if any snapshot has gallery arrays of different sizes
+ */
+int stress_swap(const vector<Mat> &faces, const vector<string> &labels, int readers, int seconds, int prototypes,
+                function<void(const string&)> report);
+/**
+ * compare scatter-gather over shard worker processes with local gallery, then kill one worker
+ * and check that queries end within timeout with answers of the others, returns non-zero on mismatch
+ */
+int bench_shards(const Recognizer &model, const vector<Mat> &faces, int shards, int timeoutMs,
+                 function<void(const string&)> report);
+
+#endif // BENCHMARK_H
@@ -0,0 +1,83 @@
+#include "framegate.h"
+
+const double FrameGate::MOTION_THRESHOLD = 2.0;
+const double FrameGate::BLUR_THRESHOLD = 30.0;
+const int FrameGate::MIN_FACE_SIZE = 60;
+
+FrameGate::FrameGate(double motionThreshold, double blurThreshold, int minFaceSize) :
+    motionThreshold(motionThreshold),
+    blurThreshold(blurThreshold),
+    minFaceSize(minFaceSize)
+{
+    this->reset();
+}
+
+FrameGate::~FrameGate()
+{
+
+}
+
+void FrameGate::reset()
+{
+    this->reference = Mat();
+    this->frames = 0;
+    this->staticFrames = 0;
+    this->blurredFrames = 0;
+    this->smallFaces = 0;
+}
+
+FrameGate::Verdict FrameGate::check(const Mat &frame)
+{
+    this->frames++;
+    if(frame.empty())
+        return PASS;
+
+    Mat gray;
+    if(frame.channels() == 3)
+        cvtColor(frame, gray, CV_BGR2GRAY);
+    else if(frame.channels() == 4)
+        cvtColor(frame, gray, CV_BGRA2GRAY);
+    else
+        gray = frame;
+
+    // sharpness: variance of Laplacian on small thumbnail
+    if(this->blurThreshold > 0)
+    {
+        Mat small, laplace;
+        resize(gray, small, this->BLUR_SIZE, 0, 0, INTER_AREA);
+        Laplacian(small, laplace, CV_32F);
+        Scalar mean, stddev;
+        meanStdDev(laplace, mean, stddev);
+        if(stddev[0] * stddev[0] < this->blurThreshold)
+        {
+            this->blurredFrames++;
+            return BLURRED;
+        }
+    }
+
+    // motion: difference energy against last frame which passed, so slow changes add up
+    Mat thumb;
+    resize(gray, thumb, this->MOTION_SIZE, 0, 0, INTER_AREA);
+    if(this->motionThreshold > 0 && !this->reference.empty())
+    {
+        Mat diff;
+        absdiff(thumb, this->reference, diff);
+        if(cv::mean(diff)[0] < this->motionThreshold)
+        {
+            this->staticFrames++;
+            return STATIC;
+        }
+    }
+    this->reference = thumb;
+    return PASS;
+}
+
+FrameGate::Verdict FrameGate::checkFace(const Rect &face)
+{
+    if(this->minFaceSize > 0 && face.width < this->minFaceSize)
+    {
+        this->smallFaces++;
+        return SMALL_FACE;
+    }
+    return PASS;
+}
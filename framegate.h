@@ -0,0 +1,60 @@
+#ifndef FRAMEGATE_H
+#define FRAMEGATE_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace cv;
+
+/**
+ * cheap check run before detection, skips frames which would not change the result
+ */
+class FrameGate
+{
+public:
+    enum Verdict
+    {
+        PASS,
+        STATIC, /** scene did not change since last processed frame */
+        BLURRED, /** too little detail to detect anything */
+        SMALL_FACE /** face too small to be recognized */
+    };
+
+    static const double MOTION_THRESHOLD; /** default mean absolute difference of gray levels */
+    static const double BLUR_THRESHOLD; /** default variance of Laplacian */
+    static const int MIN_FACE_SIZE; /** default face width in pixels */
+
+    long long frames; /** frames checked */
+    long long staticFrames; /** */
+    long long blurredFrames; /** */
+    long long smallFaces; /** */
+
+    /**
+     * thresholds of 0 disable the given check
+     */
+    FrameGate(double motionThreshold, double blurThreshold, int minFaceSize);
+    ~FrameGate();
+    /**
+     * motion and sharpness check before detection
+     */
+    Verdict check(const Mat &frame);
+    /**
+     * face size check after detection, before recognition
+     */
+    Verdict checkFace(const Rect &face);
+    /**
+     * forget reference frame and counters, e.g. when input changes
+     */
+    void reset();
+
+private:
+    const Size MOTION_SIZE = Size(80, 60); /** frame difference is computed on this thumbnail */
+    const Size BLUR_SIZE = Size(160, 120); /** Laplacian variance is computed on this thumbnail */
+
+    double motionThreshold; /** mean absolute difference of gray levels */
+    double blurThreshold; /** variance of Laplacian */
+    int minFaceSize; /** width of face in pixels */
+    Mat reference; /** thumbnail of last frame which passed */
+};
+
+#endif // FRAMEGATE_H
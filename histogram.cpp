@@ -0,0 +1,69 @@
+#include "histogram.h"
+
+#include <sstream>
+
+const int LatencyHistogram::BUCKETS;
+
+LatencyHistogram::LatencyHistogram()
+{
+    this->clear();
+}
+
+void LatencyHistogram::clear()
+{
+    for(int i = 0; i < BUCKETS; i++)
+        this->buckets[i] = 0;
+    this->total = 0;
+    this->sum = 0;
+    this->max = 0;
+}
+
+void LatencyHistogram::record(qint64 us)
+{
+    // bucket i holds latencies below 2^i us
+    int i = 0;
+    while(i < BUCKETS-1 && (1LL << i) <= us)
+        i++;
+    this->buckets[i]++;
+    this->total++;
+    this->sum += us;
+    if(us > this->max)
+        this->max = us;
+}
+
+qint64 LatencyHistogram::count() const
+{
+    return this->total;
+}
+
+qint64 LatencyHistogram::percentile(double p) const
+{
+    qint64 needed = (qint64)(p * this->total);
+    qint64 seen = 0;
+    for(int i = 0; i < BUCKETS; i++)
+    {
+        seen += this->buckets[i];
+        if(seen > needed || seen == this->total)
+            return 1LL << i;
+    }
+    return this->max;
+}
+
+string LatencyHistogram::report() const
+{
+    stringstream out;
+    if(this->total == 0)
+        return "no requests";
+    out << "requests " << this->total
+        << ", mean " << this->sum / this->total << " us"
+        << ", p50 < " << this->percentile(0.5) << " us"
+        << ", p90 < " << this->percentile(0.9) << " us"
+        << ", p99 < " << this->percentile(0.99) << " us"
+        << ", max " << this->max << " us";
+    for(int i = 0; i < BUCKETS; i++)
+    {
+        if(this->buckets[i] > 0)
+            out << "\n  < " << (1LL << i) << " us: " << this->buckets[i];
+    }
+    return out.str();
+}
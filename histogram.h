@@ -0,0 +1,38 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QtGlobal>
+
+#include <string>
+
+using namespace std;
+
+/**
+ * latency histogram with power of two buckets in microseconds
+ */
+class LatencyHistogram
+{
+public:
+    static const int BUCKETS = 32; /** */
+
+    LatencyHistogram();
+    void clear();
+    void record(qint64 us);
+    qint64 count() const;
+    /**
+     * upper bound of bucket containing given quantile, in microseconds
+     */
+    qint64 percentile(double p) const;
+    /**
+     * one line summary and non empty buckets
+     */
+    string report() const;
+
+private:
+    qint64 buckets[BUCKETS]; /** */
+    qint64 total; /** */
+    qint64 sum; /** */
+    qint64 max; /** */
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,161 @@
+#include "imageview.h"
+
+#include <QGuiApplication>
+#include <QPainter>
+#include <QScreen>
+
+PixmapLabel::PixmapLabel(ImageView *view) :
+    QLabel(view),
+    view(view)
+{
+
+}
+
+void PixmapLabel::paintEvent(QPaintEvent *event)
+{
+    int64 start = getTickCount();
+    QLabel::paintEvent(event);
+    this->view->paintTicks[ImageView::PIXMAP] += getTickCount() - start;
+    this->view->paints[ImageView::PIXMAP]++;
+}
+
+ImageView::ImageView(QWidget *parent) :
+    QWidget(parent),
+    refreshTimer(new QTimer(this)),
+    label(new PixmapLabel(this)),
+    current(BUFFERED)
+{
+    for(int p = 0; p < 2; p++)
+    {
+        this->convertTicks[p] = 0;
+        this->converts[p] = 0;
+        this->paintTicks[p] = 0;
+        this->paints[p] = 0;
+    }
+    this->label->hide();
+
+    // no point in converting frames faster than the screen shows them
+    double rate = 60.0;
+    if(QGuiApplication::primaryScreen() && QGuiApplication::primaryScreen()->refreshRate() > 0)
+        rate = QGuiApplication::primaryScreen()->refreshRate();
+    connect(this->refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    this->refreshTimer->start((int)(1000.0 / rate));
+
+    // every pixel is painted by us
+    this->setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+ImageView::~ImageView()
+{
+
+}
+
+void ImageView::setFrame(const Mat &frame, const Size &displaySize)
+{
+    // relayout only when size really changes
+    if(displaySize != this->displaySize)
+    {
+        this->displaySize = displaySize;
+        this->setMinimumSize(displaySize.width, displaySize.height);
+    }
+
+    if(this->current == BUFFERED)
+    {
+        this->pending = frame;
+        return;
+    }
+
+    // old path: every frame converted, resized in memory and copied into a new pixmap
+    int64 start = getTickCount();
+    Mat rgb;
+    if(frame.channels() == 3)
+        cvtColor(frame, rgb, CV_BGR2RGB);
+    if(frame.channels() == 4)
+        cvtColor(frame, rgb, CV_BGRA2RGB);
+    if(frame.channels() == 1)
+        cvtColor(frame, rgb, CV_GRAY2RGB);
+    if(displaySize.area() > 0 && rgb.size() != displaySize)
+        cv::resize(rgb, rgb, displaySize);
+    QImage qimage((uchar *)rgb.data, rgb.cols, rgb.rows, rgb.step, QImage::Format_RGB888);
+    this->label->setPixmap(QPixmap::fromImage(qimage));
+    this->label->resize(rgb.cols, rgb.rows);
+    this->convertTicks[PIXMAP] += getTickCount() - start;
+    this->converts[PIXMAP]++;
+}
+
+void ImageView::setPath(Path path)
+{
+    if(path == this->current)
+        return;
+    this->current = path;
+    this->pending = Mat();
+    this->label->setVisible(path == PIXMAP);
+    if(path == BUFFERED)
+        this->label->clear();
+    this->update();
+}
+
+ImageView::Path ImageView::path() const
+{
+    return this->current;
+}
+
+void ImageView::clear()
+{
+    this->pending = Mat();
+    this->buffer = Mat();
+    this->image = QImage();
+    this->label->clear();
+    this->displaySize = Size();
+    this->update();
+}
+
+double ImageView::frameMs(Path path) const
+{
+    // frames are converted and painted at different rates, so both are averaged on their own
+    double ms = 1000.0 / getTickFrequency();
+    double convert = this->converts[path] > 0 ? this->convertTicks[path] * ms / this->converts[path] : 0.0;
+    double paint = this->paints[path] > 0 ? this->paintTicks[path] * ms / this->paints[path] : 0.0;
+    return convert + paint;
+}
+
+void ImageView::refresh()
+{
+    if(this->pending.empty())
+        return;
+    int64 start = getTickCount();
+
+    // convert into reused buffer, BGRA is native QImage::Format_RGB32 layout
+    if(this->pending.channels() == 3)
+        cvtColor(this->pending, this->buffer, CV_BGR2BGRA);
+    else if(this->pending.channels() == 4)
+        this->pending.copyTo(this->buffer);
+    else if(this->pending.channels() == 1)
+        cvtColor(this->pending, this->buffer, CV_GRAY2BGRA);
+    this->pending = Mat();
+
+    // wrap buffer again only when it was reallocated
+    if(this->image.constBits() != this->buffer.data || this->image.width() != this->buffer.cols || this->image.height() != this->buffer.rows)
+        this->image = QImage(this->buffer.data, this->buffer.cols, this->buffer.rows, this->buffer.step, QImage::Format_RGB32);
+
+    this->convertTicks[BUFFERED] += getTickCount() - start;
+    this->converts[BUFFERED]++;
+    this->update();
+}
+
+void ImageView::paintEvent(QPaintEvent *)
+{
+    int64 start = getTickCount();
+    QPainter painter(this);
+    painter.fillRect(this->rect(), this->palette().window());
+    if(this->current == PIXMAP)
+        return; // child label paints the frame
+    if(!this->image.isNull())
+    {
+        // scaled by painter, frame is not resized in memory
+        QSize size = this->displaySize.area() > 0 ? QSize(this->displaySize.width, this->displaySize.height) : this->image.size();
+        painter.drawImage(QRect(QPoint(0, 0), size), this->image);
+    }
+    this->paintTicks[BUFFERED] += getTickCount() - start;
+    this->paints[BUFFERED]++;
+}
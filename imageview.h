@@ -0,0 +1,88 @@
+#ifndef IMAGEVIEW_H
+#define IMAGEVIEW_H
+
+#include <QWidget>
+#include <QImage>
+#include <QLabel>
+#include <QTimer>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace cv;
+
+class ImageView;
+
+/**
+ * QLabel of the old display path, its painting is timed by owning view
+ */
+class PixmapLabel : public QLabel
+{
+public:
+    explicit PixmapLabel(ImageView *view);
+
+protected:
+    void paintEvent(QPaintEvent *event);
+
+private:
+    ImageView *view; /** */
+};
+
+/**
+ * widget showing OpenCV frames, converted at most once per display refresh into a buffer shared with QImage
+ * the old QLabel::setPixmap path converting every frame is kept for comparison
+ */
+class ImageView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    enum Path
+    {
+        BUFFERED = 0, /** throttled conversion into reused buffer painted by the view */
+        PIXMAP = 1 /** every frame converted to RGB and set as QPixmap of child QLabel */
+    };
+
+    explicit ImageView(QWidget *parent = 0);
+    ~ImageView();
+    /**
+     * remember frame to be shown at next refresh, displaySize is the widget size to keep
+     */
+    void setFrame(const Mat &frame, const Size &displaySize);
+    /**
+     * remove shown frame
+     */
+    void clear();
+    /**
+     * switch display path, statistics of both paths are kept
+     */
+    void setPath(Path path);
+    Path path() const;
+    /**
+     * mean GUI thread time of showing one frame on path, mean conversion plus mean paint, in ms
+     */
+    double frameMs(Path path) const;
+
+protected:
+    void paintEvent(QPaintEvent *event);
+
+private slots:
+    void refresh();
+
+private:
+    friend class PixmapLabel;
+
+    Mat pending; /** newest frame not shown yet, header only */
+    Mat buffer; /** BGRA pixels, reused between frames */
+    QImage image; /** wraps buffer without copying */
+    Size displaySize; /** size last given to layout */
+    QTimer *refreshTimer; /** */
+    PixmapLabel *label; /** shown only on PIXMAP path */
+    Path current; /** */
+    int64 convertTicks[2]; /** time spent converting frames, per path */
+    long long converts[2]; /** frames converted, per path */
+    int64 paintTicks[2]; /** time spent painting, per path */
+    long long paints[2]; /** paint events, per path */
+};
+
+#endif // IMAGEVIEW_H
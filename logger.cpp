@@ -0,0 +1,240 @@
+#include "logger.h"
+
+#include <QElapsedTimer>
+
+#include <iostream>
+
+Logger::Logger(QObject *parent) :
+    QThread(parent),
+    ring(new Slot[CAPACITY]),
+    head(0),
+    tail(0),
+    errors(new Slot[ERROR_CAPACITY]),
+    errorHead(0),
+    errorTail(0),
+    minLevel(LOG_DEBUG),
+    droppedCount(0),
+    droppedReported(0),
+    droppedErrors(0),
+    droppedErrorsReported(0),
+    stopped(false),
+    lastLevel(LOG_INFO),
+    lastConsole(false),
+    repeats(0),
+    repeatsSince(0),
+    windowStart(0),
+    windowLines(0),
+    suppressed(0)
+{
+    for(unsigned int i = 0; i < CAPACITY; i++)
+        this->ring[i].sequence.store(i, memory_order_relaxed);
+    for(unsigned int i = 0; i < ERROR_CAPACITY; i++)
+        this->errors[i].sequence.store(i, memory_order_relaxed);
+}
+
+Logger::~Logger()
+{
+    this->stop();
+    delete[] this->ring;
+    delete[] this->errors;
+}
+
+void Logger::setSink(function<void(const QString&)> sink)
+{
+    this->sink = sink;
+}
+
+void Logger::setLevel(LogLevel level)
+{
+    this->minLevel.store(level);
+}
+
+bool Logger::log(LogLevel level, const string &msg, bool console)
+{
+    if(level < this->minLevel.load(memory_order_relaxed))
+        return true;
+    if(push(this->ring, CAPACITY, this->head, level, msg, console, 0))
+        return true;
+
+    // flusher is behind, drop message rather than wait, errors keep their place through reserved slots
+    if(level == LOG_ERROR)
+    {
+        if(push(this->errors, ERROR_CAPACITY, this->errorHead, level, msg, console, this->head.load(memory_order_relaxed)))
+            return true;
+        this->droppedErrors.fetch_add(1, memory_order_relaxed);
+    }
+    this->droppedCount.fetch_add(1, memory_order_relaxed);
+    return false;
+}
+
+bool Logger::push(Slot *buffer, unsigned int capacity, atomic<size_t> &head, LogLevel level, const string &msg,
+                  bool console, size_t before)
+{
+    // claim slot, producers only compete on head
+    size_t pos = head.load(memory_order_relaxed);
+    Slot *slot;
+    for(;;)
+    {
+        slot = &buffer[pos & (capacity - 1)];
+        size_t sequence = slot->sequence.load(memory_order_acquire);
+        if(sequence == pos)
+        {
+            if(head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                break;
+        }
+        else if(sequence < pos)
+        {
+            return false; // full
+        }
+        else
+        {
+            pos = head.load(memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->console = console;
+    slot->text = msg;
+    slot->before = before;
+    slot->sequence.store(pos + 1, memory_order_release);
+    return true;
+}
+
+bool Logger::pop(Slot *buffer, unsigned int capacity, size_t &tail, size_t limit, LogLevel &level, bool &console, string &text)
+{
+    Slot &slot = buffer[tail & (capacity - 1)];
+    if(slot.sequence.load(memory_order_acquire) != tail + 1 || slot.before > limit)
+        return false;
+    level = slot.level;
+    console = slot.console;
+    text.swap(slot.text);
+    slot.sequence.store(tail + capacity, memory_order_release);
+    tail++;
+    return true;
+}
+
+void Logger::stop()
+{
+    if(!this->isRunning())
+        return;
+    this->stopped.store(true);
+    this->wait();
+}
+
+long long Logger::dropped() const
+{
+    return this->droppedCount.load();
+}
+
+void Logger::run()
+{
+    QElapsedTimer clock;
+    clock.start();
+    while(!this->stopped.load())
+    {
+        QThread::msleep(FLUSH_MS);
+        this->drain(clock.elapsed());
+    }
+    this->drain(clock.elapsed(), true);
+    QString gui;
+    string out;
+    this->write_repeats(gui, out);
+    if(!out.empty())
+        cerr << out << std::flush;
+    if(!gui.isEmpty() && this->sink)
+        this->sink(gui);
+}
+
+void Logger::drain(qint64 now, bool last)
+{
+    QString gui;
+    string out;
+
+    if(now - this->windowStart >= 1000)
+    {
+        if(this->suppressed > 0)
+            this->write(to_string(this->suppressed)+" messages suppressed by rate limit", true, gui, out);
+        this->windowStart = now;
+        this->windowLines = 0;
+        this->suppressed = 0;
+    }
+
+    // reserved errors go right before the ring message which was claimed after them
+    LogLevel level;
+    bool console;
+    string text;
+    for(;;)
+    {
+        while(pop(this->errors, ERROR_CAPACITY, this->errorTail, this->tail, level, console, text))
+            this->take(level, console, text, now, gui, out);
+        if(!pop(this->ring, CAPACITY, this->tail, 0, level, console, text))
+            break;
+        this->take(level, console, text, now, gui, out);
+    }
+    // on stop nothing comes after them any more
+    while(last && pop(this->errors, ERROR_CAPACITY, this->errorTail, (size_t)-1, level, console, text))
+        this->take(level, console, text, now, gui, out);
+
+    // long runs of one message are summarized once per second
+    if(this->repeats > 0 && now - this->repeatsSince >= 1000)
+        this->write_repeats(gui, out);
+
+    long long dropped = this->droppedCount.load() - this->droppedReported;
+    if(dropped > 0)
+        this->write(to_string(dropped)+" messages dropped, log buffer full", true, gui, out);
+    this->droppedReported += dropped;
+    long long droppedErrors = this->droppedErrors.load() - this->droppedErrorsReported;
+    if(droppedErrors > 0)
+        this->write("Error: "+to_string(droppedErrors)+" of them were errors, reserved error slots full too", true, gui, out);
+    this->droppedErrorsReported += droppedErrors;
+
+    if(!out.empty())
+        cerr << out << std::flush;
+    if(!gui.isEmpty() && this->sink)
+        this->sink(gui);
+}
+
+void Logger::take(LogLevel level, bool console, string &text, qint64 now, QString &gui, string &out)
+{
+    if(text == this->lastText && level == this->lastLevel)
+    {
+        if(this->repeats == 0)
+            this->repeatsSince = now;
+        this->repeats++;
+        this->lastConsole = this->lastConsole || console;
+        return;
+    }
+    this->write_repeats(gui, out);
+
+    // suppressed line is not shown, so it must not become the line its repeats are counted against
+    if(level < LOG_ERROR && this->windowLines >= MAX_PER_SECOND)
+    {
+        this->suppressed++;
+        return;
+    }
+    this->lastText = text;
+    this->lastLevel = level;
+    this->lastConsole = console;
+    this->windowLines++;
+    this->write(text, console, gui, out);
+}
+
+void Logger::write(const string &line, bool console, QString &gui, string &out)
+{
+    if(!gui.isEmpty())
+        gui += '\n';
+    gui += QString::fromStdString(line);
+    if(console)
+    {
+        out += line;
+        out += '\n';
+    }
+}
+
+void Logger::write_repeats(QString &gui, string &out)
+{
+    if(this->repeats == 0)
+        return;
+    this->write("Last message repeated "+to_string(this->repeats)+" times", this->lastConsole, gui, out);
+    this->repeats = 0;
+}
@@ -0,0 +1,106 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QThread>
+#include <QString>
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+using namespace std;
+
+/**
+ * severity of log message
+ */
+enum LogLevel
+{
+    LOG_DEBUG = 0,
+    LOG_INFO = 1,
+    LOG_WARNING = 2,
+    LOG_ERROR = 3 /** never rate limited, reserved slots when buffer is full */
+};
+
+/**
+ * asynchronous logger, any thread can log without waiting for console or gui
+ * messages go through bounded lock-free ring buffer to flusher thread which writes them in batches
+ */
+class Logger : public QThread
+{
+public:
+    static const unsigned int CAPACITY = 4096; /** ring buffer slots, power of two */
+    static const unsigned int ERROR_CAPACITY = 64; /** slots reserved for errors logged while ring is full, power of two */
+    static const int FLUSH_MS = 50; /** */
+    static const int MAX_PER_SECOND = 100; /** lines written per second, rest is only counted */
+
+    explicit Logger(QObject *parent = 0);
+    ~Logger();
+    /**
+     * receives batch of new lines on flusher thread, has to be set before start
+     */
+    void setSink(function<void(const QString&)> sink);
+    /**
+     * messages below level are discarded
+     */
+    void setLevel(LogLevel level);
+    /**
+     * queue message, returns false if buffer is full and message was dropped
+     * with full buffer errors take reserved slots and are written in their place, they are dropped only when those are full too
+     */
+    bool log(LogLevel level, const string &msg, bool console);
+    /**
+     * write queued messages and stop flusher thread
+     */
+    void stop();
+    /**
+     * messages dropped because buffer was full, errors included
+     */
+    long long dropped() const;
+
+protected:
+    void run();
+
+private:
+    struct Slot
+    {
+        atomic<size_t> sequence; /** ready for producer when equal to position, for consumer when position+1 */
+        LogLevel level;
+        bool console;
+        string text;
+        size_t before; /** reserved errors only, ring position the error was logged before */
+    };
+
+    Slot *ring; /** */
+    atomic<size_t> head; /** next position to write */
+    size_t tail; /** next position to read, used by flusher only */
+    Slot *errors; /** reserved slots for errors */
+    atomic<size_t> errorHead; /** */
+    size_t errorTail; /** */
+    atomic<int> minLevel; /** */
+    atomic<long long> droppedCount; /** */
+    long long droppedReported; /** dropped messages already reported in log */
+    atomic<long long> droppedErrors; /** errors dropped because reserved slots were full too */
+    long long droppedErrorsReported; /** */
+    atomic<bool> stopped; /** */
+    function<void(const QString&)> sink; /** */
+
+    // flusher state
+    string lastText; /** last written message, repeats are coalesced */
+    LogLevel lastLevel; /** */
+    bool lastConsole; /** */
+    long long repeats; /** repeats of lastText not written yet */
+    qint64 repeatsSince; /** */
+    qint64 windowStart; /** start of current rate limit window */
+    int windowLines; /** */
+    long long suppressed; /** lines over rate limit in current window */
+
+    static bool push(Slot *buffer, unsigned int capacity, atomic<size_t> &head, LogLevel level, const string &msg,
+                     bool console, size_t before);
+    static bool pop(Slot *buffer, unsigned int capacity, size_t &tail, size_t limit, LogLevel &level, bool &console, string &text);
+    void drain(qint64 now, bool last = false);
+    void take(LogLevel level, bool console, string &text, qint64 now, QString &gui, string &out);
+    void write(const string &line, bool console, QString &gui, string &out);
+    void write_repeats(QString &gui, string &out);
+};
+
+#endif // LOGGER_H
@@ -1,10 +1,249 @@
 #include <QApplication>
+#include <QCoreApplication>
+#include <stdlib.h>
 #include "mainwindow.h"
+#include "shard.h"
+#include "server.h"
+#include "benchmark.h"
+#include "multistream.h"
+#ifdef POV_ALLOC_CHECK
+#include "alloccheck.h"
+#endif
+
+// optional numeric command line argument
+static int int_arg(int argc, char *argv[], int index, int defaultValue)
+{
+    return index < argc ? atoi(argv[index]) : defaultValue;
+}
+
+// train model on all images of csv file, returns 0 on success
+static int train_csv(const string &csvPath, Recognizer &model, vector<Mat> &images, vector<string> &labels)
+{
+    try
+    {
+        Recognizer::read_csv(csvPath, images, labels);
+    }
+    catch (Exception& e)
+    {
+        cerr << "Error opening csv file. Reason: " << e.msg << endl;
+        return 1;
+    }
+    model.train(images, labels, vector<int>(), -1);
+    return 0;
+}
+
+static int train_csv(const string &csvPath, Recognizer &model, vector<Mat> &images)
+{
+    vector<string> labels;
+    return train_csv(csvPath, model, images, labels);
+}
+
+static int train_csv(const string &csvPath, Recognizer &model)
+{
+    vector<Mat> images;
+    return train_csv(csvPath, model, images);
+}
 
 int main(int argc, char *argv[])
 {
+    if(argc >= 4 && string(argv[1]) == "--shard")
+    { // gallery shard worker: --shard <socket name> <gallery file>
+        QCoreApplication a(argc, argv);
+        ShardWorker worker;
+        if(worker.listen(argv[2], argv[3]))
+        {
+            cerr << "Error: cannot start gallery shard " << argv[2] << endl;
+            return 1;
+        }
+        return a.exec();
+    }
+
+    if(argc >= 3 && string(argv[1]) == "--server")
+    { // identification daemon: --server <socket name> [csv] [batch size] [deadline ms] [max queue]
+        QCoreApplication a(argc, argv);
+        IdentifyServer server;
+        if(server.init(argc >= 4 ? argv[3] : "pics2.csv"))
+            return 1;
+        if(server.listen(argv[2], int_arg(argc, argv, 4, 8), int_arg(argc, argv, 5, 5), int_arg(argc, argv, 6, 64)))
+        {
+            cerr << "Error: cannot listen on " << argv[2] << endl;
+            return 1;
+        }
+        return a.exec();
+    }
+
+    if(argc >= 4 && string(argv[1]) == "--loadgen")
+    { // load generator: --loadgen <socket name> <image> [requests] [concurrency] [open loop req/s]
+        QCoreApplication a(argc, argv);
+        LoadGenerator generator;
+        if(generator.start(argv[2], argv[3], int_arg(argc, argv, 4, 1000), int_arg(argc, argv, 5, 8), int_arg(argc, argv, 6, 0)))
+            return 1;
+        return a.exec();
+    }
+
+    if(argc >= 2 && string(argv[1]) == "--bench-detect")
+    { // detector benchmark: --bench-detect [csv] [cascade files...]
+        QCoreApplication a(argc, argv);
+        vector<string> cascades;
+        for(int i = 3; i < argc; i++)
+            cascades.push_back(argv[i]);
+        if(cascades.empty())
+            cascades = PreprocessImg::availableFaceCascades();
+        return bench_detectors(argc >= 3 ? argv[2] : "pics2.csv", cascades, [](const string &line) { cerr << line << endl; });
+    }
+
+    if(argc >= 2 && string(argv[1]) == "--bench-knn")
+    { // KNN benchmark: --bench-knn [csv] [coarse dims]
+        QCoreApplication a(argc, argv);
+        vector<Mat> images;
+        vector<string> labels;
+        try
+        {
+            Recognizer::read_csv(argc >= 3 ? argv[2] : "pics2.csv", images, labels);
+        }
+        catch (Exception& e)
+        {
+            cerr << "Error opening csv file. Reason: " << e.msg << endl;
+            return 1;
+        }
+        // every fifth image is a query against gallery of the rest, like first cross-validation fold
+        vector<int> groups(images.size());
+        vector<Mat> faces;
+        for(unsigned int i = 0; i < images.size(); i++)
+        {
+            groups[i] = i % 5;
+            if(groups[i] == 0)
+                faces.push_back(images[i]);
+        }
+        Recognizer model;
+        model.train(images, labels, groups, 0);
+        model.coarseDims = int_arg(argc, argv, 3, 0);
+        return bench_knn(model, faces, [](const string &line) { cerr << line << endl; });
+    }
+
+    if(argc >= 3 && string(argv[1]) == "--bench-gate")
+    { // frame gate benchmark: --bench-gate <video> [csv] [motion threshold] [blur threshold] [min face size]
+        QCoreApplication a(argc, argv);
+        Recognizer model;
+        if(train_csv(argc >= 4 ? argv[3] : "pics2.csv", model))
+            return 1;
+        FrameGate gate(argc >= 5 ? atof(argv[4]) : FrameGate::MOTION_THRESHOLD,
+                       argc >= 6 ? atof(argv[5]) : FrameGate::BLUR_THRESHOLD,
+                       int_arg(argc, argv, 6, FrameGate::MIN_FACE_SIZE));
+        return bench_gate(argv[2], model, gate, [](const string &line) { cerr << line << endl; });
+    }
+
+    if(argc >= 5 && string(argv[1]) == "--streams")
+    { // concurrent streams: --streams <csv> <seconds> <camera index or video>...
+        QCoreApplication a(argc, argv);
+        shared_ptr<Recognizer> model = make_shared<Recognizer>();
+        if(train_csv(argv[2], *model))
+            return 1;
+        StreamProcessor processor(model, QThread::idealThreadCount());
+        for(int i = 4; i < argc; i++)
+            processor.addStream(argv[i]);
+        processor.run(atoi(argv[3]));
+        processor.report([](const string &line) { cerr << line << endl; });
+        return 0;
+    }
+
+    if(argc >= 4 && string(argv[1]) == "--bench-streams")
+    { // stream scaling benchmark: --bench-streams <csv> <video> [max streams] [seconds]
+        QCoreApplication a(argc, argv);
+        shared_ptr<Recognizer> model = make_shared<Recognizer>();
+        if(train_csv(argv[2], *model))
+            return 1;
+        return bench_streams(argv[3], model, int_arg(argc, argv, 4, 16), int_arg(argc, argv, 5, 10),
+                             [](const string &line) { cerr << line << endl; });
+    }
+
+    if(argc >= 3 && string(argv[1]) == "--bench-scale")
+    { // gallery scaling benchmark: --bench-scale <csv> [random|perturbed] [max entries] [dims] [table csv]
+        QCoreApplication a(argc, argv);
+        Recognizer base;
+        vector<Mat> images;
+        if(train_csv(argv[2], base, images))
+            return 1;
+        SynthMode mode = argc >= 4 && string(argv[3]) == "perturbed" ? SYNTH_PERTURBED : SYNTH_RANDOM;
+        vector<int> sizes;
+        for(long long entries = 10000; entries <= int_arg(argc, argv, 4, 1000000); entries *= 10)
+            sizes.push_back((int)entries);
+        // up to 100 query faces spread over whole dataset
+        vector<Mat> faces;
+        for(unsigned int i = 0; i < images.size(); i += max((size_t)1, images.size() / 100))
+            faces.push_back(images[i]);
+        return bench_scaling(base, mode, sizes, int_arg(argc, argv, 5, 50), faces, argc >= 7 ? argv[6] : "",
+                             [](const string &line) { cerr << line << endl; });
+    }
+
+    if(argc >= 3 && string(argv[1]) == "--bench-tiered")
+    { // tiered gallery benchmark: --bench-tiered <csv> [entries] [dims] [queries] [skew]
+        QCoreApplication a(argc, argv);
+        Recognizer base, model;
+        if(train_csv(argv[2], base))
+            return 1;
+        synth_gallery(base, SYNTH_RANDOM, int_arg(argc, argv, 3, 1000000), 10, int_arg(argc, argv, 4, 50), 42, model);
+        base.clear();
+        vector<double> budgets;
+        budgets.push_back(0.0);
+        budgets.push_back(0.01);
+        budgets.push_back(0.1);
+        budgets.push_back(0.5);
+        return bench_tiered(model, budgets, int_arg(argc, argv, 5, 10000), argc >= 7 ? atof(argv[6]) : 1.1,
+                            [](const string &line) { cerr << line << endl; });
+    }
+
+    if(argc >= 3 && string(argv[1]) == "--bench-tiles")
+    { // tiled detection benchmark: --bench-tiles <image> [max face] [repeats]
+        QCoreApplication a(argc, argv);
+        return bench_tiles(argv[2], int_arg(argc, argv, 3, 300), int_arg(argc, argv, 4, 5),
+                           [](const string &line) { cerr << line << endl; });
+    }
+
+    if(argc >= 2 && string(argv[1]) == "--check-alloc")
+    { // allocation check of recognition hot path: --check-alloc [csv], only in build with CONFIG+=alloc_check
+#ifdef POV_ALLOC_CHECK
+        QCoreApplication a(argc, argv);
+        Recognizer model;
+        vector<Mat> images;
+        if(train_csv(argc >= 3 ? argv[2] : "pics2.csv", model, images))
+            return 1;
+        return check_allocations(model, images, [](const string &line) { cerr << line << endl; });
+#else
+        cerr << "Error: allocation check is built only by qmake CONFIG+=alloc_check" << endl;
+        return 1;
+#endif
+    }
+
+    if(argc >= 2 && string(argv[1]) == "--stress-swap")
+    { // model swap stress test: --stress-swap [csv] [readers] [seconds] [prototypes]
+        QCoreApplication a(argc, argv);
+        Recognizer model;
+        vector<Mat> images;
+        vector<string> labels;
+        if(train_csv(argc >= 3 ? argv[2] : "pics2.csv", model, images, labels))
+            return 1;
+        return stress_swap(images, labels, int_arg(argc, argv, 3, QThread::idealThreadCount()), int_arg(argc, argv, 4, 10),
+                           int_arg(argc, argv, 5, 3), [](const string &line) { cerr << line << endl; });
+    }
+
+    if(argc >= 2 && string(argv[1]) == "--bench-shards")
+    { // sharded gallery check: --bench-shards [shards] [csv] [timeout ms]
+        QCoreApplication a(argc, argv);
+        Recognizer model;
+        vector<Mat> images;
+        if(train_csv(argc >= 4 ? argv[3] : "pics2.csv", model, images))
+            return 1;
+        return bench_shards(model, images, int_arg(argc, argv, 2, 4), int_arg(argc, argv, 4, 200),
+                            [](const string &line) { cerr << line << endl; });
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
+    if(argc >= 2 && string(argv[1]) == "--compare-display")
+    { // display path comparison: --compare-display [interval ms]
+        w.compare_display(int_arg(argc, argv, 2, 5000));
+    }
     w.show();
 
     return a.exec();
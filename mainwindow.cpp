@@ -6,35 +6,65 @@ using namespace cv;
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    gate(FrameGate::MOTION_THRESHOLD, FrameGate::BLUR_THRESHOLD, FrameGate::MIN_FACE_SIZE),
+    displayCompareMs(0)
 {
     ui->setupUi(this);
     this->init_gui();
 
-    if( !this->face_cascade.load(this->FACE_CASCADE_PATH) ||
-        !this->right_eye_cascade.load(this->RIGHT_EYE_CASCADE_PATH) ||
-        !this->left_eye_cascade.load(this->LEFT_EYE_CASCADE_PATH))
+    // flusher appends whole batches of lines, one queued call per batch
+    this->logger.setLevel(this->LOG_LEVEL);
+    this->logger.setSink([this](const QString &lines) {
+        QMetaObject::invokeMethod(this, "append_message", Qt::QueuedConnection, Q_ARG(QString, lines));
+    });
+    this->logger.start();
+
+    if(PreprocessImg::loadCascades())
     {
-        this->show_message("Error: loading cascade files\n", true);
+        this->show_message("Error: loading cascade files", true, LOG_ERROR);
         this->disable_gui();
     }
+    PreprocessImg::setTiledDetection(this->TILED_MAX_FACE);
 
     this->timer = new QTimer(this);
     connect(timer, SIGNAL(timeout()), this, SLOT(update_cam_left_image()));
     this->timer->stop();
+    this->displayClock.start();
+
+    this->trainFailed = false;
+    this->trainWatcher = new QFutureWatcher<void>(this);
+    connect(this->trainWatcher, SIGNAL(finished()), this, SLOT(training_finished()));
 }
 
 MainWindow::~MainWindow()
 {
+    this->trainWatcher->waitForFinished();
+    this->benchFuture.waitForFinished();
+    this->logger.stop();
     delete ui;
 }
 
-void MainWindow::show_message(const string &msg, bool console_out)
+void MainWindow::show_message(const string &msg, bool console_out, LogLevel level)
 {
-    this->ui->textEdit->appendPlainText(QString::fromStdString(msg));
-    if(console_out)
-        cerr << msg << endl;
-    return;
+    // console and widget are written by logger thread, so neither gui nor training waits for them
+    this->logger.log(level, msg, console_out);
+}
+
+void MainWindow::append_message(const QString &msg)
+{
+    this->ui->textEdit->appendPlainText(msg);
+}
+
+void MainWindow::compare_display(int intervalMs)
+{
+    this->displayCompareMs = intervalMs > 0 ? intervalMs : 0;
+    this->displayClock.restart();
+    if(this->displayCompareMs == 0)
+    {
+        this->ui->labelLeft->setPath(ImageView::BUFFERED);
+        this->ui->labelRight->setPath(ImageView::BUFFERED);
+    }
 }
 
 
@@ -43,6 +73,32 @@ void MainWindow::on_actionExit_triggered()
     this->close();
 }
 
+void MainWindow::on_comboDetector_activated(int index)
+{
+    string path = this->ui->comboDetector->itemText(index).toStdString();
+    if(PreprocessImg::setFaceCascade(path))
+    {
+        this->show_message("Error: cannot load face detector "+path, true, LOG_ERROR);
+        this->ui->comboDetector->setCurrentIndex(this->ui->comboDetector->findText(QString::fromStdString(PreprocessImg::faceCascade())));
+        return;
+    }
+    this->show_message("Face detector: "+path, false);
+}
+
+void MainWindow::on_actionBenchmarkDetectors_triggered()
+{
+    if(this->benchFuture.isRunning())
+    {
+        this->show_message("Benchmark is already running", false);
+        return;
+    }
+    vector<string> cascades = PreprocessImg::availableFaceCascades();
+    string csvPath = this->CSV_PATH;
+    this->benchFuture = QtConcurrent::run([this, csvPath, cascades]() {
+        bench_detectors(csvPath, cascades, [this](const string &line) { this->show_message(line, true); });
+    });
+}
+
 void MainWindow::init_gui()
 {
     this->imgSize = Size(this->IMG_WIDTH, this->IMG_HEIGHT);
@@ -55,6 +111,13 @@ void MainWindow::init_gui()
     this->ui->labelLeft->clear();
     this->ui->labelRight->clear();
 
+    // offer every face detector available in working directory
+    this->ui->comboDetector->clear();
+    vector<string> cascades = PreprocessImg::availableFaceCascades();
+    for(unsigned int i = 0; i < cascades.size(); i++)
+        this->ui->comboDetector->addItem(QString::fromStdString(cascades[i]));
+    this->ui->comboDetector->setCurrentIndex(this->ui->comboDetector->findText(QString::fromStdString(PreprocessImg::faceCascade())));
+
     this->ui->labelLeft->setMinimumWidth(this->IMG_WIDTH);
     this->ui->labelLeft->setMinimumHeight(this->IMG_HEIGHT);
     this->ui->labelRight->setMinimumWidth(this->IMG_WIDTH);
@@ -80,7 +143,7 @@ void MainWindow::load_input_image(const string &path)
     this->leftImage = imread(path, CV_LOAD_IMAGE_COLOR);
     if(this->leftImage.empty())
     {
-        this->show_message("Error: Cannot load file: "+path, false);
+        this->show_message("Error: Cannot load file: "+path, false, LOG_ERROR);
         this->ui->button2->setEnabled(false);
         this->ui->labelLeft->clear();
         this->ui->labelRight->clear();
@@ -105,6 +168,18 @@ void MainWindow::on_radioButtonPhoto_clicked()
 }
 
 void MainWindow::init_recognizer()
+{
+    if(this->trainWatcher->isRunning())
+    {
+        this->show_message("Training is already running", false);
+        return;
+    }
+    // recognition keeps using current model until the new one is published
+    this->trainFailed = false;
+    this->trainWatcher->setFuture(QtConcurrent::run(this, &MainWindow::load_and_train));
+}
+
+void MainWindow::load_and_train()
 {
     // load train samples
     this->show_message("Start Load CSV file with train samples...", true);
@@ -114,23 +189,57 @@ void MainWindow::init_recognizer()
     }
     catch (Exception& e)
     {
-        this->show_message("Error opening file \""+this->CSV_PATH+"\". Reason: " + e.msg, true);
-        this->disable_gui();
+        this->show_message("Error opening file \""+this->CSV_PATH+"\". Reason: " + e.msg, true, LOG_ERROR);
+        this->trainFailed = true;
         return;
     }
     this->show_message("CSV file with train samples loaded successfully", true);
 
-    // init structures for training
-    this->projections.clear();
-    this->transposedEV = Mat();
-    this->eugenVal = Mat();
-    this->mean = Mat();
-    this->pca = PCA();
-
     // train our model
     this->show_message("Training...", true);
-    this->train(this->images, this->labels, -1);
+    shared_ptr<const Recognizer> model = this->train(this->images, this->labels, -1);
     this->show_message("Training done", true);
+    if(this->PROTOTYPES_PER_IDENTITY > 0)
+        model = this->compact(model);
+    this->publish(model);
+}
+
+void MainWindow::training_finished()
+{
+    if(this->trainFailed)
+    {
+        this->disable_gui();
+        return;
+    }
+    this->init_shards();
+}
+
+shared_ptr<const Recognizer> MainWindow::snapshot() const
+{
+    return atomic_load(&this->model);
+}
+
+void MainWindow::publish(shared_ptr<const Recognizer> model)
+{
+    atomic_store(&this->model, model);
+}
+
+void MainWindow::init_shards()
+{
+    this->shards.stop();
+    this->shardModel.reset();
+    shared_ptr<const Recognizer> model = this->snapshot();
+    if(this->SHARD_COUNT <= 0 || !model)
+        return;
+
+    this->show_message("Starting "+to_string(this->SHARD_COUNT)+" gallery shards...", true);
+    if(this->shards.start(*model, this->SHARD_COUNT, this->SHARD_ASSIGNMENT, this->SHARD_TIMEOUT_MS))
+    {
+        this->show_message("Error: cannot start gallery shards, using local gallery", true, LOG_ERROR);
+        return;
+    }
+    this->shardModel = model;
+    this->show_message("Gallery shard workers started, local gallery is used until they connect", true);
 }
 
 void MainWindow::on_button1_clicked()
@@ -185,6 +294,8 @@ void MainWindow::on_button1_clicked()
             this->ui->button3->setEnabled(true);
             this->timer->start(10);
             this->camSource = VideoCapture(CAM_DEV_ID);
+            this->gate.reset();
+            this->lastRecognized = "unknown";
         }
     }
 
@@ -225,7 +336,7 @@ void MainWindow::on_button3_clicked()
 
     if(this->leftImage.empty())
     {
-        this->show_message("Error: Cannot load input image", false);
+        this->show_message("Error: Cannot load input image", false, LOG_ERROR);
         this->ui->button2->setEnabled(false);
         return;
     }
@@ -244,6 +355,18 @@ void MainWindow::on_button4_clicked()
 
 
 void MainWindow::on_button5_clicked()
+{
+    if(this->trainWatcher->isRunning())
+    {
+        this->show_message("Training is already running", false);
+        return;
+    }
+    // folds are trained as private models, published model stays in use
+    this->trainFailed = false;
+    this->trainWatcher->setFuture(QtConcurrent::run(this, &MainWindow::cross_validate));
+}
+
+void MainWindow::cross_validate()
 {
     if(this->images.empty() || this->labels.empty())
     { // in case no images and labels are loaded
@@ -254,8 +377,8 @@ void MainWindow::on_button5_clicked()
         }
         catch (Exception& e)
         {
-            this->show_message("Error opening file \""+this->CSV_PATH+"\". Reason: " + e.msg, true);
-            this->disable_gui();
+            this->show_message("Error opening file \""+this->CSV_PATH+"\". Reason: " + e.msg, true, LOG_ERROR);
+            this->trainFailed = true;
             return;
         }
         this->show_message("CSV file with train samples loaded successfully", true);
@@ -280,30 +403,44 @@ void MainWindow::on_button5_clicked()
 
     int err = 0;
     int testNum = 0;
+    // compacted gallery is evaluated on the same folds for comparison
+    int compactErr = 0;
+    size_t fullSize = 0, compactSize = 0;
+    int64 fullTicks = 0, compactTicks = 0;
 
     for(int j = 0; j < groupsNum; j++)
     {
-        // init structures for training
-        this->projections.clear();
-        this->transposedEV = Mat();
-        this->eugenVal = Mat();
-        this->mean = Mat();
-        this->pca = PCA();
         this->show_message("Training for test "+to_string(j)+"...", true);
-        this->train(this->images, this->labels, j);
+        shared_ptr<const Recognizer> fold = this->train(this->images, this->labels, j);
         this->show_message("Training for test "+to_string(j)+" done", true);
 
+        shared_ptr<const Recognizer> compacted;
+        if(this->PROTOTYPES_PER_IDENTITY > 0)
+            compacted = this->compact(fold);
+
         int actErr = 0;
         int actTestNum = 0;
+        RecognizeScratch scratch;
 
         for(unsigned int i = 0; i < this->images.size(); i++)
         {
             if(this->groups[i] != j)
                 continue;
             actTestNum++;
-            if(this->labels[i].compare(this->recognize(this->images[i])) != 0)
+            int64 start = getTickCount();
+            if(this->labels[i].compare(fold->name(fold->recognize_id(this->images[i], scratch))) != 0)
                 actErr++;
+            fullTicks += getTickCount() - start;
+            if(!compacted)
+                continue;
+            start = getTickCount();
+            if(this->labels[i].compare(compacted->name(compacted->recognize_id(this->images[i], scratch))) != 0)
+                compactErr++;
+            compactTicks += getTickCount() - start;
         }
+        fullSize += fold->projections.size();
+        if(compacted)
+            compactSize += compacted->projections.size();
 
         err += actErr;
         testNum += actTestNum;
@@ -313,48 +450,32 @@ void MainWindow::on_button5_clicked()
 
     this->show_message("Cross-validation done... success in "+to_string(testNum-err)+"/"+to_string(testNum)+" => "+to_string((testNum-err)/(double)testNum)+"%", true);
 
+    if(this->PROTOTYPES_PER_IDENTITY > 0 && testNum > 0)
+    {
+        this->show_message("Compacted gallery ("+to_string(this->PROTOTYPES_PER_IDENTITY)+" prototypes per identity)... success in "+to_string(testNum-compactErr)+"/"+to_string(testNum)+" => "+to_string((testNum-compactErr)/(double)testNum)+"%", true);
+        this->show_message("Gallery size "+to_string(compactSize/groupsNum)+" instead of "+to_string(fullSize/groupsNum)+" => "+to_string(compactSize/(double)fullSize), true);
+        this->show_message("Recognition "+to_string(compactTicks*1000.0/getTickFrequency()/testNum)+" ms instead of "+to_string(fullTicks*1000.0/getTickFrequency()/testNum)+" ms per face => speedup "+to_string(fullTicks/(double)max(compactTicks, (int64)1)), true);
+    }
+
 }
 
 void MainWindow::update_left_image()
 {
-    Mat image;
     if(this->leftImage.empty())
         return;
-    this->ui->labelLeft->clear();
-
-    if(this->leftImage.channels() == 3)
-        cvtColor(this->leftImage, image, CV_BGR2RGB);
-    if(this->leftImage.channels() == 4)
-        cvtColor(this->leftImage, image, CV_BGRA2RGB);
-    if(this->leftImage.channels() == 1)
-        cvtColor(this->leftImage, image, CV_GRAY2RGB);
-    this->qleftImage = QImage((uchar *)image.data, image.cols, image.rows, image.step, QImage::Format_RGB888);
-    this->ui->labelLeft->setPixmap(QPixmap::fromImage(this->qleftImage));
 
-    this->ui->labelLeft->setMinimumWidth(this->qleftImage.width());
-    this->ui->labelLeft->setMinimumHeight(this->qleftImage.height());
-    this->imgSize = Size(this->qleftImage.width(), this->qleftImage.height());
+    // frame is converted and painted by the view at display refresh rate
+    this->imgSize = this->leftImage.size();
+    this->ui->labelLeft->setFrame(this->leftImage, this->imgSize);
 }
 
 void MainWindow::update_right_image()
 {
-    Mat image;
     if(this->rightImage.empty())
         return;
-    this->ui->labelRight->clear();
 
-    if(this->rightImage.channels() == 3)
-        cvtColor(this->rightImage, image, CV_BGR2RGB);
-    if(this->rightImage.channels() == 4)
-        cvtColor(this->rightImage, image, CV_BGRA2RGB);
-    if(this->rightImage.channels() == 1)
-        cvtColor(this->rightImage, image, CV_GRAY2RGB);
-    cv::resize(image, image, Size(this->leftImage.rows, this->leftImage.rows));
-    this->qrightImage = QImage((uchar *)image.data, image.cols, image.rows, image.step, QImage::Format_RGB888);
-    this->ui->labelRight->setPixmap(QPixmap::fromImage(this->qrightImage));
-
-    this->ui->labelRight->setMinimumWidth(this->qrightImage.width());
-    this->ui->labelRight->setMinimumHeight(this->qrightImage.height());
+    // face is shown as square of left image height, scaled when painted
+    this->ui->labelRight->setFrame(this->rightImage, Size(this->leftImage.rows, this->leftImage.rows));
 }
 
 
@@ -368,49 +489,59 @@ void MainWindow::update_cam_left_image()
     if(image.empty())
         return;
 
+    // display paths take turns, so both are timed with the same camera and load
+    if(this->displayCompareMs > 0 && this->displayClock.elapsed() >= this->displayCompareMs)
+    {
+        ImageView::Path path = this->ui->labelLeft->path() == ImageView::BUFFERED ? ImageView::PIXMAP : ImageView::BUFFERED;
+        this->ui->labelLeft->setPath(path);
+        this->ui->labelRight->setPath(path);
+        this->displayClock.restart();
+    }
+
     // show input from cam on the left image
     this->camSource >> this->leftImage;
     this->update_left_image();
 
-    // Preprocess online image and show it on the right image
-    PreprocessImg img(this->leftImage);
-    if(!img.preprocess())
+    // static or blurred frames reuse last result and never reach the cascade
+    if(this->gate.check(this->leftImage) == FrameGate::PASS)
     {
-        img.imgCropedFace.copyTo(this->rightImage);
-        this->update_right_image();
+        // Preprocess online image and show it on the right image
+        PreprocessImg img(this->leftImage);
+        if(!img.preprocess())
+        {
+            img.imgCropedFace.copyTo(this->rightImage);
+            this->update_right_image();
+            if(this->gate.checkFace(img.faceRect) == FrameGate::PASS)
+                this->lastRecognized = this->recognize(img.imgPreprocessedFace);
+            else
+                this->lastRecognized = "unknown"; // face too small to recognize, older result would be wrong
+        }
+        else
+        {
+            this->lastRecognized = "unknown";
+        }
     }
-    this->show_message("Face recognized: " + this->recognize(img.imgPreprocessedFace), false);
+    this->show_stats();
+    this->show_message("Face recognized: " + this->lastRecognized, false);
+}
 
-    this->ui->labelLeft->setMinimumWidth(this->qleftImage.width());
-    this->ui->labelLeft->setMinimumHeight(this->qleftImage.height());
-    this->ui->labelRight->setMinimumWidth(this->qrightImage.width());
-    this->ui->labelRight->setMinimumHeight(this->qrightImage.height());
-    this->imgSize = Size(this->qleftImage.width(), this->qleftImage.height());
+void MainWindow::show_stats()
+{
+    QString message = QString("Frames %1, gated: static %2, blurred %3, small face %4, display: buffered %5 ms/frame")
+            .arg(this->gate.frames).arg(this->gate.staticFrames)
+            .arg(this->gate.blurredFrames).arg(this->gate.smallFaces)
+            .arg(this->ui->labelLeft->frameMs(ImageView::BUFFERED) + this->ui->labelRight->frameMs(ImageView::BUFFERED), 0, 'f', 2);
+    if(this->displayCompareMs > 0)
+        message += QString(", QLabel::setPixmap %1 ms/frame")
+                .arg(this->ui->labelLeft->frameMs(ImageView::PIXMAP) + this->ui->labelRight->frameMs(ImageView::PIXMAP), 0, 'f', 2);
+    this->ui->statusBar->showMessage(message);
 }
 
 void MainWindow::read_csv(const string &filename, vector<Mat>& images, vector<string>& labels, char separator)
 {
-    ifstream file(filename.c_str(), ifstream::in);
-    if (!file) {
-        string error_message = "No valid input file was given, please check the given filename.";
-        CV_Error(CV_StsBadArg, error_message);
-    }
-    string line, path, classlabel;
-    while (getline(file, line)) {
-        stringstream liness(line);
-        getline(liness, path, separator);
-        getline(liness, classlabel);
-        if(!path.empty() && !classlabel.empty()) {
-            Mat m = imread(path, 1);
-            if(m.empty())
-                continue;
-            this->show_message("Loading and preprocessing training image: " + path, true);
-            PreprocessImg img = PreprocessImg(m);
-            img.preprocess();
-            images.push_back(img.imgPreprocessedFace);
-            labels.push_back(classlabel);
-        }
-    }
+    Recognizer::read_csv(filename, images, labels, separator, [this](const string &path) {
+        this->show_message("Loading and preprocessing training image: " + path, true, LOG_DEBUG);
+    });
     this->images=images;
     this->labels=labels;
 }
@@ -436,116 +567,42 @@ Mat MainWindow::norm_0_255(const Mat& src)
     return dst;
 }
 
-void MainWindow::train(vector<Mat> &images, vector<string> &labels, int testGroup)
+shared_ptr<const Recognizer> MainWindow::train(vector<Mat> &images, vector<string> &labels, int testGroup)
 {
-    if (images.size() == 0)
-        return;
-    //          number of samples	  dimensionality		  type
-    Mat matPCA(images.size(), images[0].total(), CV_32FC1);
-
-    for(unsigned int i = 0; i < images.size(); i++)
-    {
-        if(testGroup != -1 && i < this->groups.size())
-        {
-            if(this->groups[i] == testGroup)
-            {
-                //this->show_message("Skipping testing image: " + labels[i], true);
-                continue;
-            }
-        }
-        if(images.empty() || images[i].total() != images[0].total())
-        { //skip unconvertable images
-            this->show_message("Skipping uncovertable image: " + labels[i], true);
-            continue;
-        }
-        if(images[i].isContinuous())
-        { // Make reshape happy by cloning for non-continuous matrices:
-            images[i].reshape(1, 1).convertTo(matPCA.row(i), CV_32FC1, 1, 0);
-        }
-        else
-        {
-            images[i].clone().reshape(1, 1).convertTo(matPCA.row(i), CV_32FC1, 1, 0);
-        }
-        this->projections.push_back(images[i]);
-    }
-    this->pca(matPCA, Mat(), CV_PCA_DATA_AS_ROW, matPCA.rows);
-    this->mean = this->pca.mean.reshape(1,1);
-    this->eugenVal = this->pca.eigenvalues.clone();
-    transpose(this->pca.eigenvectors, this->transposedEV);
-
-    for(unsigned int i = 0; i< this->projections.size(); i++)
-    {
-        this->projections[i] = subspaceProject(this->transposedEV, this->mean, matPCA.row(i));
-    }
+    // model is built aside and never changed after it is returned
+    shared_ptr<Recognizer> model = make_shared<Recognizer>();
+    model->coarseDims = this->KNN_COARSE_DIMS;
+    int skipped = model->train(images, labels, this->groups, testGroup);
+    if(skipped > 0)
+        this->show_message("Skipping "+to_string(skipped)+" uncovertable images", true);
+    return model;
+}
 
-    return;
+shared_ptr<const Recognizer> MainWindow::compact(const shared_ptr<const Recognizer> &model)
+{
+    shared_ptr<Recognizer> compacted = make_shared<Recognizer>(*model);
+    compacted->compact(this->PROTOTYPES_PER_IDENTITY);
+    this->show_message("Gallery compacted from "+to_string(model->projections.size())+" to "+to_string(compacted->projections.size())+" entries", true);
+    return compacted;
 }
 
 String MainWindow::recognize(Mat frame)
 {
-    Mat image;
-    if(frame.channels() == 3)
-        cvtColor(frame,image, CV_BGR2GRAY);
-    else if(frame.channels() == 4)
-        cvtColor(frame,image, CV_BGRA2GRAY);
-    else if(frame.channels() == 1)
-        frame.copyTo(image);
-    string name = "unknown";
-    unsigned int k=5;
-    if(this->labels.size() <= k)
+    // snapshot stays alive for whole call even if training publishes a new one meanwhile
+    shared_ptr<const Recognizer> model = this->snapshot();
+    if(!model)
         return "unknown";
+    // local gallery answers until every shard worker has connected
+    if(!this->shards.isRunning() || model != this->shardModel || !this->shards.connect_workers())
+        return model->name(model->recognize_id(frame, this->scratch));
 
-    //project target face to subspace
-    Mat target = subspaceProject(this->transposedEV, this->mean, image.reshape(1,1));
-
-    vector<unsigned int> classes(k,0);
-    vector<double> distances(k,DBL_MAX);
-
-    double distance = DBL_MAX;
-
-    //find k nearest neighbours
-    for(unsigned int i = 0; i < this->projections.size(); i++)
-    //find KNN for k = 5
-    {
-        distance= norm(projections[i],target,NORM_L2);//norml2
-        for(unsigned int j = 0; j < k; j++)
-        {
-            if(distance < distances[j])
-            {
-				//discard the worst match and shift remaining down
-                for(unsigned int l = k-1; l > j; l--)
-                {
-                    distances[l] = distances[l-1];
-                    classes[l] = classes[l-1];
-                }
-                classes[j] = i;
-                distances[j] = distance;
-                break;
-            }
-        }
-    }
-
-    map<string,Weight> neighbours;
-    //count occurence of classes
-    for(unsigned int i = 0; i < k; i++)
-    {
-        Weight &weight = neighbours[this->labels[classes[i]]];
-        weight.count++;
-        weight.distance += distances[i];
-    }
-
-    //vote for the best match
-    double min_weight = DBL_MAX;
-    for (map<string,Weight>::iterator itr = neighbours.begin(); itr != neighbours.end();++itr)
-    {
-        double weight = itr->second.distance / (double) itr->second.count;
-        if(weight < min_weight)
-        {
-            min_weight = weight;
-            name = itr->first;
-        }
-    }
+    if(model->labels.size() <= Recognizer::K)
+        return "unknown";
 
-    return name;
+    // project once, nearest neighbours are searched by shards
+    vector<Neighbour> neighbours;
+    this->shards.nearest(model->project(frame), Recognizer::K, neighbours);
+    if(this->shards.answered() < this->shards.shardCount())
+        this->show_message("Warning: "+to_string(this->shards.shardCount()-this->shards.answered())+" gallery shards did not answer in time", false, LOG_WARNING);
+    return Recognizer::vote(neighbours);
 }
-
@@ -4,6 +4,10 @@
 #include <QMainWindow>
 #include <QFileDialog>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentRun>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -15,8 +19,15 @@
 #include <iostream>
 #include <stdio.h>
 #include <vector>
+#include <memory>
 
 #include "preprocessimg.h"
+#include "recognizer.h"
+#include "shard.h"
+#include "benchmark.h"
+#include "framegate.h"
+#include "imageview.h"
+#include "logger.h"
 
 using namespace cv;
 using namespace std;
@@ -26,15 +37,6 @@ namespace Ui
     class MainWindow;
 }
 
-/**
- *
- */
-struct Weight
-{
-    unsigned int count;
-    double distance;
-};
-
 /**
  *
  */
@@ -52,9 +54,13 @@ public:
      */
     ~MainWindow();
     /**
-     *
+     * log message to text box and optionally console, does not block, callable from any thread
      */
-    void show_message(const string& msg, bool console_out);
+    void show_message(const string& msg, bool console_out, LogLevel level = LOG_INFO);
+    /**
+     * alternate camera display between buffered and old QLabel::setPixmap path every intervalMs and time both
+     */
+    void compare_display(int intervalMs);
 
 private slots:
     /**
@@ -101,12 +107,32 @@ private slots:
      *
      */
     void on_button5_clicked();
+    /**
+     *
+     */
+    void on_comboDetector_activated(int index);
+    /**
+     *
+     */
+    void on_actionBenchmarkDetectors_triggered();
+    /**
+     *
+     */
+    void append_message(const QString &msg);
+    /**
+     *
+     */
+    void training_finished();
 
 private:
     const string CSV_PATH = "pics2.csv"; /** */
-    const string FACE_CASCADE_PATH = "haarcascade_frontalface_alt.xml"; /** */
-    const string RIGHT_EYE_CASCADE_PATH = "haarcascade_righteye_2splits.xml"; /** */
-    const string LEFT_EYE_CASCADE_PATH = "haarcascade_lefteye_2splits.xml"; /** */
+    const int KNN_COARSE_DIMS = 0; /** leading components of coarse KNN pre-filter, 0 disables it */
+    const int PROTOTYPES_PER_IDENTITY = 0; /** gallery compaction after training, 0 keeps every training image */
+    const int SHARD_COUNT = 0; /** number of gallery shard worker processes, 0 keeps whole gallery in this process */
+    const ShardCoordinator::Assignment SHARD_ASSIGNMENT = ShardCoordinator::BY_IDENTITY; /** */
+    const int SHARD_TIMEOUT_MS = 200; /** how long to wait for slow shards */
+    const LogLevel LOG_LEVEL = LOG_INFO; /** LOG_DEBUG shows every loaded training image */
+    const int TILED_MAX_FACE = 0; /** detect faces up to this size on parallel tiles, 0 detects on whole frame */
     const int CAM_DEV_ID = 0; /** */
     const int IMG_WIDTH = 250; /** */
     const int IMG_HEIGHT = 250; /** */
@@ -115,31 +141,32 @@ private:
 
     Ui::MainWindow *ui; /** */
     QTimer *timer; /** */
+    Logger logger; /** */
 
     vector<Mat> images; /** *///storing loaded images of db
-    vector<Mat >projections;  /** *///storing loaded images of db
     vector<string> labels;   /** *///storing labels of images
     vector<int> groups; /** storing info about number of testing group for images*/
-    CascadeClassifier face_cascade; /** */
-    CascadeClassifier right_eye_cascade; /** */
-    CascadeClassifier left_eye_cascade; /** */
 
     Size imgSize;  /** */// size of input image
 
-    QImage qrightImage;  /** */// original displayed input image
-    QImage qleftImage;  /** */// changed displayed image
-
     Mat leftImage;  /** */// original input image
     Mat rightImage;  /** */// changed image
 
     VideoCapture camSource;  /** */// camera device
+    FrameGate gate; /** skips static and unusable camera frames */
+    string lastRecognized; /** result reused for gated frames */
+    RecognizeScratch scratch; /** buffers of camera recognitions, gui thread only */
+    int displayCompareMs; /** camera display alternates buffered and QLabel::setPixmap path this often, 0 keeps buffered path */
+    QElapsedTimer displayClock; /** time since display path was switched */
 
     string inputPathFile; /** */ // path to input file
 
-    Mat mean; /** */
-    Mat eugenVal; /** */
-    Mat transposedEV; /** */
-    PCA pca; /** */
+    shared_ptr<const Recognizer> model; /** published model snapshot, never changed, swapped atomically */
+    ShardCoordinator shards; /** gallery served by worker processes */
+    shared_ptr<const Recognizer> shardModel; /** snapshot the shards were started from */
+    QFutureWatcher<void> *trainWatcher; /** background training or cross-validation */
+    QFuture<void> benchFuture; /** background detector benchmark */
+    bool trainFailed; /** set by background job, read when it finished */
 
     /**
      *
@@ -162,17 +189,45 @@ private:
      */
     Mat norm_0_255(const Mat&);
     /**
-     *
+     * build new model snapshot, does not publish it
      */
-    void train(vector<Mat> &images, vector<string> &labels, int testGroup);
+    shared_ptr<const Recognizer> train(vector<Mat> &images, vector<string> &labels, int testGroup);
     /**
      *
      */
     String recognize(Mat);
     /**
-     *
+     * show gate counters and display cost in status bar
+     */
+    void show_stats();
+    /**
+     * copy of model with gallery compressed to PROTOTYPES_PER_IDENTITY prototypes per identity
+     */
+    shared_ptr<const Recognizer> compact(const shared_ptr<const Recognizer> &model);
+    /**
+     * start loading and training in background
      */
     void init_recognizer();
+    /**
+     * background job: load csv, train and publish model
+     */
+    void load_and_train();
+    /**
+     * background job: 10-fold cross-validation
+     */
+    void cross_validate();
+    /**
+     * currently published model, may be empty
+     */
+    shared_ptr<const Recognizer> snapshot() const;
+    /**
+     * atomically replace published model, running recognitions finish on the old one
+     */
+    void publish(shared_ptr<const Recognizer> model);
+    /**
+     * start gallery shard workers for trained model, if enabled
+     */
+    void init_shards();
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,268 @@
+#include "multistream.h"
+#include "preprocessimg.h"
+
+#include <QThreadStorage>
+
+#include <ctype.h>
+#include <stdlib.h>
+
+// camera is given by its index, anything else is a video file
+static bool is_camera(const string &source)
+{
+    for(unsigned int i = 0; i < source.size(); i++)
+    {
+        if(!isdigit((unsigned char)source[i]))
+            return false;
+    }
+    return !source.empty();
+}
+
+StreamReader::StreamReader(StreamProcessor *owner, int stream, const string &source) :
+    owner(owner),
+    stream(stream),
+    source(source),
+    stopped(0)
+{
+
+}
+
+StreamReader::~StreamReader()
+{
+    this->stop();
+    this->wait();
+}
+
+void StreamReader::stop()
+{
+    this->stopped.storeRelease(1);
+}
+
+void StreamReader::run()
+{
+    bool camera = is_camera(this->source);
+    VideoCapture capture;
+    if(camera)
+        capture.open(atoi(this->source.c_str()));
+    else
+        capture.open(this->source);
+    if(!capture.isOpened())
+    {
+        this->owner->stream_ended(this->stream);
+        return;
+    }
+
+    // video files stand in for cameras, so they are played at their own frame rate and looped
+    double fps = camera ? 0.0 : capture.get(CV_CAP_PROP_FPS);
+    if(!camera && (fps <= 0.0 || fps > 240.0))
+        fps = 25.0;
+    QElapsedTimer pace;
+    pace.start();
+    long long frames = 0;
+
+    while(!this->stopped.loadAcquire())
+    {
+        Mat frame;
+        if(!capture.read(frame))
+        {
+            if(camera)
+                break;
+            capture.set(CV_CAP_PROP_POS_FRAMES, 0);
+            if(!capture.read(frame))
+                break;
+        }
+        this->owner->frame_captured(this->stream, frame);
+        frames++;
+
+        if(!camera)
+        {
+            qint64 wait = (qint64)(frames * 1000 / fps) - pace.elapsed();
+            if(wait > 0)
+                QThread::msleep(wait);
+        }
+    }
+    this->owner->stream_ended(this->stream);
+}
+
+StreamTask::StreamTask(StreamProcessor *owner, int stream, const Mat &frame, qint64 capturedNs) :
+    owner(owner),
+    stream(stream),
+    frame(frame),
+    capturedNs(capturedNs)
+{
+
+}
+
+// recognition buffers of pool thread, reused by all streams it serves
+static QThreadStorage<RecognizeScratch*> scratches;
+
+void StreamTask::run()
+{
+    // cascades are loaded once per pool thread, model is shared read-only
+    if(!scratches.hasLocalData())
+        scratches.setLocalData(new RecognizeScratch());
+    PreprocessImg img(this->frame);
+    if(!img.preprocess())
+        this->owner->model()->recognize_id(img.imgPreprocessedFace, *scratches.localData());
+    this->owner->frame_processed(this->stream, this->capturedNs);
+}
+
+StreamProcessor::StreamProcessor(shared_ptr<const Recognizer> model, int threads) :
+    recognizer(model),
+    threads(threads > 0 ? threads : QThread::idealThreadCount()),
+    elapsedMs(0)
+{
+    this->pool.setMaxThreadCount(this->threads);
+    this->clock.start();
+}
+
+StreamProcessor::~StreamProcessor()
+{
+    for(unsigned int s = 0; s < this->streams.size(); s++)
+        delete this->streams[s].reader;
+    this->pool.waitForDone();
+}
+
+void StreamProcessor::addStream(const string &source)
+{
+    Stream stream;
+    stream.source = source;
+    stream.reader = 0;
+    stream.latestNs = 0;
+    stream.fresh = false;
+    stream.ended = false;
+    stream.busy = 0;
+    stream.captured = 0;
+    stream.processed = 0;
+    stream.dropped = 0;
+    this->streams.push_back(stream);
+}
+
+void StreamProcessor::run(int seconds)
+{
+    if(this->streams.empty())
+        return;
+    for(unsigned int s = 0; s < this->streams.size(); s++)
+        this->streams[s].reader = new StreamReader(this, s, this->streams[s].source);
+
+    QElapsedTimer runClock;
+    runClock.start();
+    for(unsigned int s = 0; s < this->streams.size(); s++)
+        this->streams[s].reader->start();
+
+    // one stream may use more threads only when there are fewer streams than threads
+    int perStream = max(1, this->threads / (int)this->streams.size());
+    unsigned int next = 0;
+    int inFlight = 0;
+
+    this->mutex.lock();
+    while(runClock.elapsed() < seconds * 1000LL)
+    {
+        // fair dispatch: round robin from the stream after the last one served
+        bool submitted = true;
+        while(submitted)
+        {
+            submitted = false;
+            inFlight = 0;
+            for(unsigned int s = 0; s < this->streams.size(); s++)
+                inFlight += this->streams[s].busy;
+            if(inFlight >= this->threads)
+                break;
+            for(unsigned int n = 0; n < this->streams.size(); n++)
+            {
+                unsigned int s = (next + n) % this->streams.size();
+                Stream &stream = this->streams[s];
+                if(!stream.fresh || stream.busy >= perStream)
+                    continue;
+                stream.fresh = false;
+                stream.busy++;
+                this->pool.start(new StreamTask(this, s, stream.latest, stream.latestNs));
+                stream.latest = Mat();
+                next = s + 1;
+                submitted = true;
+                break;
+            }
+        }
+
+        bool running = false;
+        for(unsigned int s = 0; s < this->streams.size(); s++)
+            running = running || !this->streams[s].ended || this->streams[s].busy > 0;
+        if(!running)
+            break;
+        this->wake.wait(&this->mutex, 50);
+    }
+    this->elapsedMs = runClock.elapsed();
+    this->mutex.unlock();
+
+    for(unsigned int s = 0; s < this->streams.size(); s++)
+        this->streams[s].reader->stop();
+    for(unsigned int s = 0; s < this->streams.size(); s++)
+    {
+        this->streams[s].reader->wait();
+        delete this->streams[s].reader;
+        this->streams[s].reader = 0;
+    }
+    this->pool.waitForDone();
+}
+
+void StreamProcessor::report(function<void(const string&)> report) const
+{
+    double seconds = max(this->elapsedMs, (qint64)1) / 1000.0;
+    for(unsigned int s = 0; s < this->streams.size(); s++)
+    {
+        const Stream &stream = this->streams[s];
+        report("Stream "+to_string(s)+" ("+stream.source+"): "+to_string(stream.processed / seconds)+" fps processed, "
+               +to_string(stream.captured / seconds)+" fps captured, "+to_string(stream.dropped)+" dropped, latency p50 < "
+               +to_string(stream.latency.percentile(0.5) / 1000.0)+" ms, p99 < "+to_string(stream.latency.percentile(0.99) / 1000.0)+" ms");
+    }
+    report("All "+to_string(this->streams.size())+" streams on "+to_string(this->threads)+" threads: "+to_string(this->throughput())+" fps");
+}
+
+double StreamProcessor::throughput() const
+{
+    long long processed = 0;
+    for(unsigned int s = 0; s < this->streams.size(); s++)
+        processed += this->streams[s].processed;
+    return processed * 1000.0 / max(this->elapsedMs, (qint64)1);
+}
+
+shared_ptr<const Recognizer> StreamProcessor::model() const
+{
+    return this->recognizer;
+}
+
+qint64 StreamProcessor::now() const
+{
+    return this->clock.nsecsElapsed();
+}
+
+void StreamProcessor::frame_captured(int stream, const Mat &frame)
+{
+    qint64 capturedNs = this->now();
+    QMutexLocker lock(&this->mutex);
+    Stream &s = this->streams[stream];
+    if(s.fresh)
+        s.dropped++;
+    s.latest = frame;
+    s.latestNs = capturedNs;
+    s.fresh = true;
+    s.captured++;
+    this->wake.wakeAll();
+}
+
+void StreamProcessor::frame_processed(int stream, qint64 capturedNs)
+{
+    qint64 doneNs = this->now();
+    QMutexLocker lock(&this->mutex);
+    Stream &s = this->streams[stream];
+    s.busy--;
+    s.processed++;
+    s.latency.record((doneNs - capturedNs) / 1000);
+    this->wake.wakeAll();
+}
+
+void StreamProcessor::stream_ended(int stream)
+{
+    QMutexLocker lock(&this->mutex);
+    this->streams[stream].ended = true;
+    this->wake.wakeAll();
+}
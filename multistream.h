@@ -0,0 +1,114 @@
+#ifndef MULTISTREAM_H
+#define MULTISTREAM_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "recognizer.h"
+#include "histogram.h"
+
+using namespace std;
+
+class StreamProcessor;
+
+/**
+ * capture thread of one stream, hands only the newest frame over
+ */
+class StreamReader : public QThread
+{
+public:
+    StreamReader(StreamProcessor *owner, int stream, const string &source);
+    ~StreamReader();
+    void stop();
+
+protected:
+    void run();
+
+private:
+    StreamProcessor *owner; /** */
+    int stream; /** index of stream in owner */
+    string source; /** camera index or video file */
+    QAtomicInt stopped; /** */
+};
+
+/**
+ * detection and recognition of one frame, runs on shared pool
+ */
+class StreamTask : public QRunnable
+{
+public:
+    StreamTask(StreamProcessor *owner, int stream, const Mat &frame, qint64 capturedNs);
+    void run();
+
+private:
+    StreamProcessor *owner; /** */
+    int stream; /** */
+    Mat frame; /** */
+    qint64 capturedNs; /** */
+};
+
+/**
+ * processes N streams at once with one read-only model and one thread pool shared by all of them
+ */
+class StreamProcessor
+{
+public:
+    StreamProcessor(shared_ptr<const Recognizer> model, int threads);
+    ~StreamProcessor();
+    void addStream(const string &source);
+    /**
+     * capture and process all streams for given time
+     */
+    void run(int seconds);
+    /**
+     * per-stream fps and latency of last run
+     */
+    void report(function<void(const string&)> report) const;
+    /**
+     * frames processed per second by all streams together in last run
+     */
+    double throughput() const;
+
+    shared_ptr<const Recognizer> model() const;
+    qint64 now() const;
+    void frame_captured(int stream, const Mat &frame);
+    void frame_processed(int stream, qint64 capturedNs);
+    void stream_ended(int stream);
+
+private:
+    struct Stream
+    {
+        string source;
+        StreamReader *reader;
+        Mat latest; /** newest frame waiting for processing */
+        qint64 latestNs; /** capture time of latest */
+        bool fresh; /** latest was not processed yet */
+        bool ended; /** */
+        int busy; /** frames in flight */
+        long long captured; /** */
+        long long processed; /** */
+        long long dropped; /** frames replaced by newer one before processing */
+        LatencyHistogram latency; /** capture to result */
+    };
+
+    shared_ptr<const Recognizer> recognizer; /** */
+    QThreadPool pool; /** shared by all streams */
+    int threads; /** */
+    vector<Stream> streams; /** */
+    QMutex mutex; /** guards streams */
+    QWaitCondition wake; /** new frame captured or processed */
+    QElapsedTimer clock; /** */
+    qint64 elapsedMs; /** duration of last run */
+};
+
+#endif // MULTISTREAM_H
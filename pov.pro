@@ -4,9 +4,9 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui network
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 TARGET = pov
 TEMPLATE = app
@@ -15,15 +15,50 @@ CONFIG += c++11
 
 SOURCES += main.cpp\
         mainwindow.cpp \
-    preprocessimg.cpp
+    preprocessimg.cpp \
+    recognizer.cpp \
+    shard.cpp \
+    protocol.cpp \
+    server.cpp \
+    benchmark.cpp \
+    framegate.cpp \
+    imageview.cpp \
+    histogram.cpp \
+    multistream.cpp \
+    logger.cpp \
+    synthetic.cpp \
+    tiered.cpp
 
 HEADERS  += mainwindow.h \
-    preprocessimg.h
+    preprocessimg.h \
+    recognizer.h \
+    shard.h \
+    protocol.h \
+    server.h \
+    benchmark.h \
+    framegate.h \
+    imageview.h \
+    histogram.h \
+    multistream.h \
+    logger.h \
+    synthetic.h \
+    tiered.h
 
 FORMS    += mainwindow.ui
 
+# allocation check build, counts every heap allocation of the process: qmake CONFIG+=alloc_check
+alloc_check {
+    TARGET = pov-alloccheck
+    DEFINES += POV_ALLOC_CHECK
+    SOURCES += alloccheck.cpp
+    HEADERS += alloccheck.h
+}
+
 INCLUDEPATH += C:/opencv-mingw/install/includes
 
+# working set size for memory figures of benchmarks
+win32: LIBS += -lpsapi
+
 LIBS        += -LC:/opencv-mingw/install/x64/mingw/bin
 LIBS        += -lopencv_calib3d2410 \
     -lopencv_contrib2410 \
@@ -1,15 +1,171 @@
 #include "preprocessimg.h"
 
+#include <QDir>
+#include <QThread>
+#include <QThreadStorage>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <algorithm>
+#include <math.h>
+
+const string PreprocessImg::DEFAULT_FACE_CASCADE_PATH = "haarcascade_frontalface_alt.xml";
+const string PreprocessImg::LEFT_EYE_CASCADE_PATH_1 = "haarcascade_mcs_lefteye.xml";
+const string PreprocessImg::LEFT_EYE_CASCADE_PATH_2 = "haarcascade_lefteye_2splits.xml";
+const string PreprocessImg::LEFT_EYE_CASCADE_PATH_3 = "haarcascade_eye.xml";
+const string PreprocessImg::RIGHT_EYE_CASCADE_PATH_1 = "haarcascade_mcs_righteye.xml";
+const string PreprocessImg::RIGHT_EYE_CASCADE_PATH_2 = "haarcascade_righteye_2splits.xml";
+const string PreprocessImg::RIGHT_EYE_CASCADE_PATH_3 = "haarcascade_eye.xml";
+
+QMutex PreprocessImg::faceCascadeMutex;
+string PreprocessImg::faceCascadePath = PreprocessImg::DEFAULT_FACE_CASCADE_PATH;
+QAtomicInt PreprocessImg::tiledMaxFace(0);
+
+// every thread loads its own cascades once
+static QThreadStorage<Cascades*> threadCascades;
+
+static Cascades *thread_cascades()
+{
+    if(!threadCascades.hasLocalData())
+        threadCascades.setLocalData(new Cascades());
+    return threadCascades.localData();
+}
+
 PreprocessImg::PreprocessImg(Mat &src)
 {
     src.copyTo(this->imgOrig);
-    this->face_cascade.load(this->FACE_CASCADE_PATH);
-    this->left_eye_cascade_1.load(this->LEFT_EYE_CASCADE_PATH_1);
-    this->left_eye_cascade_2.load(this->LEFT_EYE_CASCADE_PATH_2);
-    this->left_eye_cascade_3.load(this->LEFT_EYE_CASCADE_PATH_3);
-    this->right_eye_cascade_1.load(this->RIGHT_EYE_CASCADE_PATH_1);
-    this->right_eye_cascade_2.load(this->RIGHT_EYE_CASCADE_PATH_2);
-    this->right_eye_cascade_3.load(this->RIGHT_EYE_CASCADE_PATH_3);
+    loadCascades();
+    this->cascades = thread_cascades();
+}
+
+int PreprocessImg::loadCascades()
+{
+    Cascades *c = thread_cascades();
+    if(!c->eyesLoaded)
+    {
+        c->eyesLoaded = c->left_eye_cascade_1.load(LEFT_EYE_CASCADE_PATH_1) &&
+            c->left_eye_cascade_2.load(LEFT_EYE_CASCADE_PATH_2) &&
+            c->left_eye_cascade_3.load(LEFT_EYE_CASCADE_PATH_3) &&
+            c->right_eye_cascade_1.load(RIGHT_EYE_CASCADE_PATH_1) &&
+            c->right_eye_cascade_2.load(RIGHT_EYE_CASCADE_PATH_2) &&
+            c->right_eye_cascade_3.load(RIGHT_EYE_CASCADE_PATH_3);
+    }
+
+    string path = faceCascade();
+    if(c->facePath != path)
+    {
+        c->facePath = c->face_cascade.load(path) ? path : "";
+    }
+    return c->eyesLoaded && !c->facePath.empty() ? 0 : 1;
+}
+
+int PreprocessImg::setFaceCascade(const string &path)
+{
+    // check the file before other threads start to reload it
+    CascadeClassifier cascade;
+    if(!cascade.load(path))
+        return 1;
+    QMutexLocker lock(&faceCascadeMutex);
+    faceCascadePath = path;
+    return 0;
+}
+
+string PreprocessImg::faceCascade()
+{
+    QMutexLocker lock(&faceCascadeMutex);
+    return faceCascadePath;
+}
+
+vector<string> PreprocessImg::availableFaceCascades()
+{
+    QStringList filters;
+    filters << "haarcascade_frontal*.xml" << "lbpcascade_frontal*.xml" << "haarcascade_profile*.xml" << "lbpcascade_profile*.xml";
+    QStringList files = QDir().entryList(filters, QDir::Files, QDir::Name);
+    vector<string> paths;
+    for(int i = 0; i < files.size(); i++)
+        paths.push_back(files[i].toStdString());
+    return paths;
+}
+
+void PreprocessImg::detectFaces(CascadeClassifier &cascade, const Mat &gray, vector<Rect> &faces)
+{
+    cascade.detectMultiScale(gray, faces, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(30, 30));
+}
+
+void PreprocessImg::detectAllFaces(CascadeClassifier &cascade, const Mat &gray, int maxFace, vector<Rect> &faces)
+{
+    cascade.detectMultiScale(gray, faces, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE, Size(30, 30), maxFace > 0 ? Size(maxFace, maxFace) : Size());
+}
+
+/**
+ * part of frame searched by one pool thread
+ */
+struct Tile
+{
+    Rect rect; /** */
+    vector<Rect> faces; /** found faces in frame coordinates */
+};
+
+static bool bigger(const Rect &a, const Rect &b)
+{
+    return a.area() > b.area();
+}
+
+void PreprocessImg::detectFacesTiled(const Mat &gray, int maxFace, vector<Rect> &faces)
+{
+    faces.clear();
+    if(gray.empty())
+        return;
+    maxFace = max(maxFace, 30);
+
+    // tiles start every step pixels and reach maxFace further, so a face starting in one tile ends in it
+    // step gives about four tiles per core, but at least 2*maxFace to keep overlap small against tile area
+    int cores = max(1, QThread::idealThreadCount());
+    int step = max(2 * maxFace, (int)sqrt(gray.total() / (4.0 * cores)));
+    vector<Tile> tiles;
+    for(int y = 0; y < gray.rows; y += step)
+    {
+        for(int x = 0; x < gray.cols; x += step)
+        {
+            Tile tile;
+            tile.rect = Rect(x, y, step + maxFace, step + maxFace) & Rect(0, 0, gray.cols, gray.rows);
+            tiles.push_back(tile);
+            if(x + step + maxFace >= gray.cols)
+                break;
+        }
+        if(y + step + maxFace >= gray.rows)
+            break;
+    }
+
+    // idle pool threads take next tile, every thread detects with its own cascade
+    QtConcurrent::blockingMap(tiles, [&gray, maxFace](Tile &tile) {
+        if(loadCascades())
+            return;
+        detectAllFaces(thread_cascades()->face_cascade, gray(tile.rect), maxFace, tile.faces);
+        for(unsigned int i = 0; i < tile.faces.size(); i++)
+            tile.faces[i] += tile.rect.tl();
+    });
+
+    // non-maximum suppression over tile seams: the bigger of two overlapping detections wins
+    vector<Rect> found;
+    for(unsigned int t = 0; t < tiles.size(); t++)
+        found.insert(found.end(), tiles[t].faces.begin(), tiles[t].faces.end());
+    sort(found.begin(), found.end(), bigger);
+    for(unsigned int i = 0; i < found.size(); i++)
+    {
+        bool duplicate = false;
+        for(unsigned int j = 0; j < faces.size() && !duplicate; j++)
+        {
+            double common = (found[i] & faces[j]).area();
+            duplicate = common > 0.3 * (found[i].area() + faces[j].area() - common) || common > 0.7 * found[i].area();
+        }
+        if(!duplicate)
+            faces.push_back(found[i]);
+    }
+}
+
+void PreprocessImg::setTiledDetection(int maxFace)
+{
+    tiledMaxFace.storeRelease(max(maxFace, 0));
 }
 
 PreprocessImg::~PreprocessImg()
@@ -131,19 +287,19 @@ int PreprocessImg::detectEyes(Mat &face, Point &leftEye, Point &rightEye)
     Mat left_eye_region = face_gray(Rect(0, 0, face_gray.cols/2, face_gray.rows/2));
     Mat right_eye_region = face_gray(Rect(face_gray.cols/2, 0, face_gray.cols/2, face_gray.rows/2));
 
-    this->left_eye_cascade_1.detectMultiScale(left_eye_region, leftEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
+    this->cascades->left_eye_cascade_1.detectMultiScale(left_eye_region, leftEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
     if (leftEyes.size() == 0)
-        this->left_eye_cascade_2.detectMultiScale(left_eye_region, leftEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
+        this->cascades->left_eye_cascade_2.detectMultiScale(left_eye_region, leftEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
     if (leftEyes.size() == 0)
-        this->left_eye_cascade_3.detectMultiScale(left_eye_region, leftEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
+        this->cascades->left_eye_cascade_3.detectMultiScale(left_eye_region, leftEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
     if (leftEyes.size() == 0)
         return 1;
 
-    this->right_eye_cascade_1.detectMultiScale(right_eye_region, rightEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
+    this->cascades->right_eye_cascade_1.detectMultiScale(right_eye_region, rightEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
     if (rightEyes.size() == 0)
-        this->right_eye_cascade_2.detectMultiScale(right_eye_region, rightEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
+        this->cascades->right_eye_cascade_2.detectMultiScale(right_eye_region, rightEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
     if (rightEyes.size() == 0)
-        this->right_eye_cascade_3.detectMultiScale(right_eye_region, rightEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
+        this->cascades->right_eye_cascade_3.detectMultiScale(right_eye_region, rightEyes, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(20, 20));
     if (rightEyes.size() == 0)
         return 1;
 
@@ -177,14 +333,21 @@ int PreprocessImg::rotateFace(const Mat &face, Mat &out, Point &leftEye, Point &
 int PreprocessImg::detectFace(Mat frame, Mat& out)
 {
     std::vector<Rect> faces;
+    if(this->cascades->facePath.empty())
+        return 1;
     this->equalize(frame, this->imgEq, false);
     Mat frame_gray = this->imgEq.clone();
 
     //-- Detect faces
-    this->face_cascade.detectMultiScale(frame_gray, faces, 1.1, 2, 0|CV_HAAR_SCALE_IMAGE|CV_HAAR_FIND_BIGGEST_OBJECT, Size(30, 30));
+    int maxFace = tiledMaxFace.loadAcquire();
+    if(maxFace > 0)
+        detectFacesTiled(frame_gray, maxFace, faces);
+    else
+        detectFaces(this->cascades->face_cascade, frame_gray, faces);
     if (faces.size() == 0)
         return 1;
 
+    this->faceRect = faces[0];
     this->imgOrig(faces[0]).copyTo(out);
 
     return 0;
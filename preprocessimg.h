@@ -13,21 +13,17 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/objdetect/objdetect.hpp>
 
+#include <QMutex>
+#include <QAtomicInt>
+
 using namespace std;
 using namespace cv;
 
-class PreprocessImg
+/**
+ * cascades of one thread, CascadeClassifier cannot be used from more threads at once
+ */
+struct Cascades
 {
-
-private:
-    const string FACE_CASCADE_PATH = "haarcascade_frontalface_alt.xml"; /** */
-    const string LEFT_EYE_CASCADE_PATH_1 = "haarcascade_mcs_lefteye.xml"; /** */
-    const string LEFT_EYE_CASCADE_PATH_2 = "haarcascade_lefteye_2splits.xml"; /** */
-    const string LEFT_EYE_CASCADE_PATH_3 = "haarcascade_eye.xml"; /** */
-    const string RIGHT_EYE_CASCADE_PATH_1 = "haarcascade_mcs_righteye.xml"; /** */
-    const string RIGHT_EYE_CASCADE_PATH_2 = "haarcascade_righteye_2splits.xml"; /** */
-    const string RIGHT_EYE_CASCADE_PATH_3 = "haarcascade_eye.xml"; /** */
-
     CascadeClassifier face_cascade; /** */
     CascadeClassifier right_eye_cascade_1; /** */
     CascadeClassifier right_eye_cascade_2; /** */
@@ -35,6 +31,28 @@ private:
     CascadeClassifier left_eye_cascade_1; /** */
     CascadeClassifier left_eye_cascade_2; /** */
     CascadeClassifier left_eye_cascade_3; /** */
+    bool eyesLoaded; /** */
+    string facePath; /** face cascade currently loaded, empty if none */
+
+    Cascades() : eyesLoaded(false) {}
+};
+
+class PreprocessImg
+{
+
+private:
+    static const string LEFT_EYE_CASCADE_PATH_1; /** */
+    static const string LEFT_EYE_CASCADE_PATH_2; /** */
+    static const string LEFT_EYE_CASCADE_PATH_3; /** */
+    static const string RIGHT_EYE_CASCADE_PATH_1; /** */
+    static const string RIGHT_EYE_CASCADE_PATH_2; /** */
+    static const string RIGHT_EYE_CASCADE_PATH_3; /** */
+
+    static QMutex faceCascadeMutex; /** */
+    static string faceCascadePath; /** face detector selected for all threads */
+    static QAtomicInt tiledMaxFace; /** max face size of tiled detection, 0 detects on whole frame */
+
+    Cascades *cascades; /** cascades of thread which created this instance */
     const int FACE_WIDTH = 300; /** */
     const int FACE_HEIGHT = 300; /** */
 
@@ -48,8 +66,44 @@ public:
     Mat imgRotatedFace;
     Mat imgPreprocessedFace;
     Mat imgCropedFace;
+    Rect faceRect; /** position of detected face in imgOrig */
+
+    static const string DEFAULT_FACE_CASCADE_PATH; /** */
 
     PreprocessImg(Mat &src);
+    /**
+     * load cascades of calling thread if not loaded yet or face detector changed, returns 0 on success
+     */
+    static int loadCascades();
+    /**
+     * select face detector (Haar or LBP cascade file) for all threads, returns 0 on success
+     */
+    static int setFaceCascade(const string &path);
+    /**
+     * path of selected face detector
+     */
+    static string faceCascade();
+    /**
+     * face cascade files (Haar and LBP, frontal and profile) found in working directory
+     */
+    static vector<string> availableFaceCascades();
+    /**
+     * run face cascade on equalized gray frame, same parameters for every detector
+     */
+    static void detectFaces(CascadeClassifier &cascade, const Mat &gray, vector<Rect> &faces);
+    /**
+     * all faces from 30 pixels up to maxFace (0 for no limit) in equalized gray frame
+     */
+    static void detectAllFaces(CascadeClassifier &cascade, const Mat &gray, int maxFace, vector<Rect> &faces);
+    /**
+     * detectAllFaces on overlapping tiles in parallel, tiles overlap by maxFace so every face fits whole into one of them
+     * duplicates from tile seams are merged, faces are sorted from the biggest
+     */
+    static void detectFacesTiled(const Mat &gray, int maxFace, vector<Rect> &faces);
+    /**
+     * use tiled detection of faces up to maxFace pixels in all threads, 0 switches back to whole frame detection
+     */
+    static void setTiledDetection(int maxFace);
     ~PreprocessImg();
     void equalize(Mat &src, Mat &dst, bool sepEqualization);
     int detectFace( Mat frame, Mat& out);
@@ -0,0 +1,27 @@
+#include "protocol.h"
+
+#include <QDataStream>
+
+void write_message(QLocalSocket *socket, const QByteArray &payload)
+{
+    QByteArray header;
+    QDataStream out(&header, QIODevice::WriteOnly);
+    out << (quint32)payload.size();
+    socket->write(header);
+    socket->write(payload);
+    socket->flush();
+}
+
+bool take_message(QByteArray &buffer, QByteArray &payload)
+{
+    if(buffer.size() < (int)sizeof(quint32))
+        return false;
+    quint32 size;
+    QDataStream in(buffer);
+    in >> size;
+    if((quint32)buffer.size() < sizeof(quint32) + size)
+        return false;
+    payload = buffer.mid(sizeof(quint32), size);
+    buffer.remove(0, sizeof(quint32) + size);
+    return true;
+}
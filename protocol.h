@@ -0,0 +1,16 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QByteArray>
+#include <QLocalSocket>
+
+/**
+ * send length prefixed message over local socket
+ */
+void write_message(QLocalSocket *socket, const QByteArray &payload);
+/**
+ * cut one complete length prefixed message from the beginning of buffer
+ */
+bool take_message(QByteArray &buffer, QByteArray &payload);
+
+#endif // PROTOCOL_H
@@ -0,0 +1,513 @@
+#include "recognizer.h"
+#include "preprocessimg.h"
+
+#include <float.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+const unsigned int Recognizer::K;
+const int Recognizer::BLOCK;
+
+Recognizer::Recognizer() :
+    coarseDims(0)
+{
+
+}
+
+Recognizer::~Recognizer()
+{
+
+}
+
+void Recognizer::clear()
+{
+    this->projections.clear();
+    this->matProjections = Mat();
+    this->labels.clear();
+    this->labelIds.clear();
+    this->names.clear();
+    this->weights.clear();
+    this->transposedEV = Mat();
+    this->eugenVal = Mat();
+    this->mean = Mat();
+    this->pca = PCA();
+}
+
+int Recognizer::train(const vector<Mat> &images, const vector<string> &labels, const vector<int> &groups, int testGroup)
+{
+    this->clear();
+    if (images.size() == 0)
+        return 0;
+
+    // select training images first, so projections and labels stay aligned
+    int skipped = 0;
+    vector<unsigned int> used;
+    for(unsigned int i = 0; i < images.size(); i++)
+    {
+        if(testGroup != -1 && i < groups.size() && groups[i] == testGroup)
+            continue;
+        if(images[i].total() != images[0].total())
+        { //skip unconvertable images
+            skipped++;
+            continue;
+        }
+        used.push_back(i);
+    }
+    if(used.empty())
+        return skipped;
+
+    //          number of samples	  dimensionality		  type
+    Mat matPCA(used.size(), images[0].total(), CV_32FC1);
+    for(unsigned int r = 0; r < used.size(); r++)
+    {
+        const Mat &image = images[used[r]];
+        if(image.isContinuous())
+        { // Make reshape happy by cloning for non-continuous matrices:
+            image.reshape(1, 1).convertTo(matPCA.row(r), CV_32FC1, 1, 0);
+        }
+        else
+        {
+            image.clone().reshape(1, 1).convertTo(matPCA.row(r), CV_32FC1, 1, 0);
+        }
+        this->labels.push_back(labels[used[r]]);
+    }
+
+    this->pca(matPCA, Mat(), CV_PCA_DATA_AS_ROW, matPCA.rows);
+    this->mean = this->pca.mean.reshape(1,1);
+    this->eugenVal = this->pca.eigenvalues.clone();
+    transpose(this->pca.eigenvectors, this->transposedEV);
+
+    for(int r = 0; r < matPCA.rows; r++)
+    {
+        this->projections.push_back(subspaceProject(this->transposedEV, this->mean, matPCA.row(r)));
+    }
+    this->build_index();
+
+    return skipped;
+}
+
+int Recognizer::compact(int prototypes)
+{
+    if(prototypes <= 0 || this->projections.empty())
+        return this->projections.size();
+
+    // gallery entries of every identity
+    map<string, vector<unsigned int> > members;
+    for(unsigned int i = 0; i < this->projections.size(); i++)
+        members[this->labels[i]].push_back(i);
+
+    vector<Mat> projections;
+    vector<string> labels;
+    vector<double> weights;
+    for(map<string, vector<unsigned int> >::iterator itr = members.begin(); itr != members.end(); ++itr)
+    {
+        const vector<unsigned int> &idx = itr->second;
+        if((int)idx.size() <= prototypes)
+        { // nothing to compress
+            for(unsigned int r = 0; r < idx.size(); r++)
+            {
+                projections.push_back(this->projections[idx[r]]);
+                labels.push_back(itr->first);
+                weights.push_back(this->weight(idx[r]));
+            }
+            continue;
+        }
+
+        Mat data(idx.size(), this->projections[0].total(), CV_32FC1);
+        for(unsigned int r = 0; r < idx.size(); r++)
+            this->projections[idx[r]].reshape(1, 1).convertTo(data.row(r), CV_32FC1);
+
+        Mat assignment, centers;
+        kmeans(data, prototypes, assignment, TermCriteria(CV_TERMCRIT_EPS+CV_TERMCRIT_ITER, 20, 0.01), 3, KMEANS_PP_CENTERS, centers);
+
+        // prototype carries number of images assigned to it into the vote
+        vector<double> clusterWeight(prototypes, 0.0);
+        for(unsigned int r = 0; r < idx.size(); r++)
+            clusterWeight[assignment.at<int>(r)] += this->weight(idx[r]);
+        for(int c = 0; c < prototypes; c++)
+        {
+            if(clusterWeight[c] <= 0)
+                continue;
+            Mat prototype;
+            centers.row(c).convertTo(prototype, this->projections[0].type());
+            projections.push_back(prototype);
+            labels.push_back(itr->first);
+            weights.push_back(clusterWeight[c]);
+        }
+    }
+
+    this->projections = projections;
+    this->labels = labels;
+    this->weights = weights;
+    this->build_index();
+    return this->projections.size();
+}
+
+void Recognizer::build_index()
+{
+    if(this->projections.empty())
+    {
+        this->matProjections = Mat();
+        return;
+    }
+
+    // continuous rows let KNN walk components with plain pointers
+    Mat rows(this->projections.size(), this->projections[0].total(), CV_32FC1);
+    for(unsigned int i = 0; i < this->projections.size(); i++)
+        this->projections[i].reshape(1, 1).convertTo(rows.row(i), CV_32FC1);
+    this->matProjections = rows;
+    for(unsigned int i = 0; i < this->projections.size(); i++)
+        this->projections[i] = rows.row(i);
+    this->intern_labels();
+}
+
+void Recognizer::intern_labels()
+{
+    map<string, int> ids;
+    this->names.clear();
+    this->labelIds.resize(this->labels.size());
+    for(unsigned int i = 0; i < this->labels.size(); i++)
+    {
+        map<string, int>::iterator itr = ids.find(this->labels[i]);
+        if(itr == ids.end())
+        {
+            itr = ids.insert(make_pair(this->labels[i], (int)this->names.size())).first;
+            this->names.push_back(this->labels[i]);
+        }
+        this->labelIds[i] = itr->second;
+    }
+}
+
+double Recognizer::weight(unsigned int i) const
+{
+    return this->weights.empty() ? 1.0 : this->weights[i];
+}
+
+void Recognizer::read_csv(const string &filename, vector<Mat> &images, vector<string> &labels, char separator,
+                          function<void(const string&)> progress)
+{
+    ifstream file(filename.c_str(), ifstream::in);
+    if (!file) {
+        string error_message = "No valid input file was given, please check the given filename.";
+        CV_Error(CV_StsBadArg, error_message);
+    }
+    string line, path, classlabel;
+    while (getline(file, line)) {
+        stringstream liness(line);
+        getline(liness, path, separator);
+        getline(liness, classlabel);
+        if(!path.empty() && !classlabel.empty()) {
+            Mat m = imread(path, 1);
+            if(m.empty())
+                continue;
+            if(progress)
+                progress(path);
+            PreprocessImg img = PreprocessImg(m);
+            img.preprocess();
+            images.push_back(img.imgPreprocessedFace);
+            labels.push_back(classlabel);
+        }
+    }
+}
+
+// convert face to one gray row, gray is used as buffer when face needs conversion
+static Mat face_row(const Mat &face, Mat &gray)
+{
+    if(face.channels() == 3)
+        cvtColor(face, gray, CV_BGR2GRAY);
+    else if(face.channels() == 4)
+        cvtColor(face, gray, CV_BGRA2GRAY);
+    else if(face.channels() == 1 && face.isContinuous())
+        return face.reshape(1,1); // already a gray face, no copy
+    else
+        face.copyTo(gray);
+    return gray.reshape(1,1);
+}
+
+static Mat face_row(const Mat &face)
+{
+    Mat gray;
+    return face_row(face, gray);
+}
+
+Mat Recognizer::project(const Mat &face) const
+{
+    //project target face to subspace
+    return subspaceProject(this->transposedEV, this->mean, face_row(face));
+}
+
+Mat Recognizer::project(const vector<Mat> &faces) const
+{
+    if(faces.empty())
+        return Mat();
+
+    // stack faces so the whole batch is projected by one matrix product
+    Mat rows(faces.size(), this->mean.cols, CV_32FC1);
+    for(unsigned int i = 0; i < faces.size(); i++)
+        face_row(faces[i]).convertTo(rows.row(i), CV_32FC1);
+    return subspaceProject(this->transposedEV, this->mean, rows);
+}
+
+void Recognizer::nearest(const Mat &target, unsigned int k, vector<Neighbour> &out, KnnStats *stats) const
+{
+    out.clear();
+    if(this->matProjections.empty() || k == 0)
+        return;
+
+    Mat query;
+    target.reshape(1, 1).convertTo(query, CV_32FC1);
+    vector<unsigned int> entries(k, 0);
+    vector<double> distances(k, DBL_MAX);
+    vector< pair<double, unsigned int> > order;
+    unsigned int found = this->search(query.ptr<float>(0), k, &entries[0], &distances[0], order, stats);
+
+    for(unsigned int j = 0; j < found; j++)
+    {
+        Neighbour neighbour;
+        neighbour.label = this->labels[entries[j]];
+        neighbour.distance = sqrt(distances[j]);
+        neighbour.weight = this->weight(entries[j]);
+        out.push_back(neighbour);
+    }
+}
+
+unsigned int Recognizer::search(const float *q, unsigned int k, unsigned int *entries, double *distances,
+                                vector< pair<double, unsigned int> > &order, KnnStats *stats) const
+{
+    const int dims = this->matProjections.cols;
+    const int rows = this->matProjections.rows;
+
+    // squared distances, sqrt is taken only for the result
+    for(unsigned int j = 0; j < k; j++)
+    {
+        entries[j] = 0;
+        distances[j] = DBL_MAX;
+    }
+    long long touched = 0;
+    long long visited = 0;
+
+    // optional coarse pass: partial distance over leading components is a lower bound,
+    // entries are then visited from the most promising and the scan stops once no bound can beat top k
+    int first = 0;
+    order.clear();
+    if(this->coarseDims > 0 && this->coarseDims < dims)
+    {
+        first = this->coarseDims;
+        order.resize(rows);
+        for(int i = 0; i < rows; i++)
+        {
+            const float *row = this->matProjections.ptr<float>(i);
+            double sum = 0.0;
+            for(int d = 0; d < first; d++)
+            {
+                double diff = row[d] - q[d];
+                sum += diff * diff;
+            }
+            order[i] = make_pair(sum, (unsigned int)i);
+        }
+        touched += (long long)rows * first;
+        sort(order.begin(), order.end());
+    }
+
+    for(int n = 0; n < rows; n++)
+    {
+        unsigned int i = order.empty() ? n : order[n].second;
+        double distance = order.empty() ? 0.0 : order[n].first;
+        if(!order.empty() && distance >= distances[k-1])
+            break;
+        visited++;
+
+        // components are sorted by eigenvalue, so most of the distance is in the first blocks
+        const float *row = this->matProjections.ptr<float>(i);
+        int d = first;
+        while(d < dims && distance < distances[k-1])
+        {
+            int end = min(d + BLOCK, dims);
+            for(; d < end; d++)
+            {
+                double diff = row[d] - q[d];
+                distance += diff * diff;
+            }
+        }
+        touched += d - first;
+        if(distance >= distances[k-1])
+            continue;
+
+        for(unsigned int j = 0; j < k; j++)
+        {
+            if(distance < distances[j])
+            {
+                //discard the worst match and shift remaining down
+                for(unsigned int l = k-1; l > j; l--)
+                {
+                    distances[l] = distances[l-1];
+                    entries[l] = entries[l-1];
+                }
+                entries[j] = i;
+                distances[j] = distance;
+                break;
+            }
+        }
+    }
+
+    if(stats)
+    {
+        stats->queries++;
+        stats->entries += visited;
+        stats->dims += touched;
+    }
+    return min(k, (unsigned int)rows);
+}
+
+void Recognizer::nearest_exact(const Mat &target, unsigned int k, vector<Neighbour> &out) const
+{
+    vector<unsigned int> classes(k,0);
+    vector<double> distances(k,DBL_MAX);
+
+    double distance = DBL_MAX;
+
+    //find k nearest neighbours
+    for(unsigned int i = 0; i < this->projections.size(); i++)
+    {
+        distance= norm(this->projections[i],target,NORM_L2);//norml2
+        for(unsigned int j = 0; j < k; j++)
+        {
+            if(distance < distances[j])
+            {
+                //discard the worst match and shift remaining down
+                for(unsigned int l = k-1; l > j; l--)
+                {
+                    distances[l] = distances[l-1];
+                    classes[l] = classes[l-1];
+                }
+                classes[j] = i;
+                distances[j] = distance;
+                break;
+            }
+        }
+    }
+
+    out.clear();
+    for(unsigned int j = 0; j < k && j < this->projections.size(); j++)
+    {
+        Neighbour neighbour;
+        neighbour.label = this->labels[classes[j]];
+        neighbour.distance = distances[j];
+        neighbour.weight = this->weight(classes[j]);
+        out.push_back(neighbour);
+    }
+}
+
+string Recognizer::vote(const vector<Neighbour> &neighbours, double *distance)
+{
+    string name = "unknown";
+
+    map<string,Weight> classes;
+    //count occurence of classes
+    for(unsigned int i = 0; i < neighbours.size(); i++)
+    {
+        Weight &weight = classes[neighbours[i].label];
+        weight.count += neighbours[i].weight;
+        weight.distance += neighbours[i].distance * neighbours[i].weight;
+    }
+
+    //vote for the best match
+    double min_weight = DBL_MAX;
+    for (map<string,Weight>::iterator itr = classes.begin(); itr != classes.end();++itr)
+    {
+        double weight = itr->second.distance / (double) itr->second.count;
+        if(weight < min_weight)
+        {
+            min_weight = weight;
+            name = itr->first;
+        }
+    }
+
+    if(distance)
+        *distance = min_weight;
+    return name;
+}
+
+string Recognizer::recognize(const Mat &face) const
+{
+    RecognizeScratch scratch;
+    return this->name(this->recognize_id(face, scratch));
+}
+
+string Recognizer::recognize_reference(const Mat &face) const
+{
+    if(this->labels.size() <= K)
+        return "unknown";
+
+    vector<Neighbour> neighbours;
+    this->nearest(this->project(face), K, neighbours);
+    return vote(neighbours);
+}
+
+int Recognizer::recognize_id(const Mat &face, RecognizeScratch &scratch, double *distance) const
+{
+    if(this->labels.size() <= K || this->labelIds.size() != this->labels.size())
+        return -1;
+
+    // project into preallocated row: (face - mean) * transposedEV, accumulated row by row of eigenvectors
+    // gemm would be shorter, but it may allocate temporary buffers through cv::fastMalloc
+    face_row(face, scratch.gray).convertTo(scratch.row, CV_32FC1);
+    if(scratch.row.cols != this->mean.cols)
+        return -1;
+    const int comps = this->transposedEV.cols;
+    scratch.projected.create(1, comps, CV_32FC1);
+    float *p = scratch.projected.ptr<float>(0);
+    const float *x = scratch.row.ptr<float>(0);
+    const float *m = this->mean.ptr<float>(0);
+    for(int c = 0; c < comps; c++)
+        p[c] = 0.0f;
+    for(int r = 0; r < scratch.row.cols; r++)
+    {
+        float v = x[r] - m[r];
+        const float *ev = this->transposedEV.ptr<float>(r);
+        for(int c = 0; c < comps; c++)
+            p[c] += v * ev[c];
+    }
+
+    unsigned int found = this->search(p, K, scratch.entries, scratch.distances, scratch.order, 0);
+
+    // weighted vote over label ids, only the rows touched by neighbours are reset afterwards
+    if(scratch.votes.size() < this->names.size())
+        scratch.votes.resize(this->names.size());
+    for(unsigned int j = 0; j < found; j++)
+    {
+        Weight &weight = scratch.votes[this->labelIds[scratch.entries[j]]];
+        double w = this->weight(scratch.entries[j]);
+        weight.count += w;
+        weight.distance += sqrt(scratch.distances[j]) * w;
+    }
+
+    int best = -1;
+    double min_weight = DBL_MAX;
+    for(unsigned int j = 0; j < found; j++)
+    {
+        int id = this->labelIds[scratch.entries[j]];
+        Weight &weight = scratch.votes[id];
+        if(weight.count == 0.0)
+            continue; // already counted
+        double average = weight.distance / weight.count;
+        // ties go to smaller label, like the vote over sorted map
+        if(average < min_weight || (best >= 0 && average == min_weight && this->names[id] < this->names[best]))
+        {
+            min_weight = average;
+            best = id;
+        }
+        weight = Weight();
+    }
+
+    if(distance)
+        *distance = min_weight;
+    return best;
+}
+
+const string &Recognizer::name(int id) const
+{
+    static const string unknown = "unknown";
+    return id >= 0 && id < (int)this->names.size() ? this->names[id] : unknown;
+}
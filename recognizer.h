@@ -0,0 +1,164 @@
+#ifndef RECOGNIZER_H
+#define RECOGNIZER_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/contrib/contrib.hpp>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+/**
+ * accumulated vote of one class among nearest neighbours
+ */
+struct Weight
+{
+    double count; /** number of training images behind the votes */
+    double distance;
+
+    Weight() : count(0.0), distance(0.0) {}
+};
+
+/**
+ * one gallery entry found by KNN search
+ */
+struct Neighbour
+{
+    string label;
+    double distance;
+    double weight; /** number of training images represented by the entry */
+};
+
+/**
+ * work done by KNN searches, summed over queries
+ */
+struct KnnStats
+{
+    long long queries; /** */
+    long long entries; /** gallery entries visited */
+    long long dims; /** components summed over all visited entries */
+
+    KnnStats() : queries(0), entries(0), dims(0) {}
+};
+
+struct RecognizeScratch;
+
+/**
+ * PCA model and gallery of projected training faces
+ */
+class Recognizer
+{
+public:
+    static const unsigned int K = 5; /** number of nearest neighbours used for voting */
+    static const int BLOCK = 16; /** components summed between early abandon checks */
+
+    vector<Mat> projections; /** projected training images, rows of matProjections, empty for synthetic galleries */
+    Mat matProjections; /** all projections in one continuous matrix */
+    vector<string> labels; /** labels of projections, same order */
+    vector<int> labelIds; /** interned labels of projections, index into names */
+    vector<string> names; /** distinct labels, in order of first occurence */
+    vector<double> weights; /** images represented by each projection, empty if every projection is one image */
+    Mat mean; /** */
+    Mat eugenVal; /** */
+    Mat transposedEV; /** */
+    PCA pca; /** */
+    int coarseDims; /** leading components of coarse pre-filter pass, 0 disables it */
+
+    Recognizer();
+    ~Recognizer();
+    /**
+     * drop trained model
+     */
+    void clear();
+    /**
+     * train model on all images except of testGroup (-1 for all), returns number of skipped images
+     */
+    int train(const vector<Mat> &images, const vector<string> &labels, const vector<int> &groups, int testGroup);
+    /**
+     * replace projections of every identity by at most prototypes k-means centres, returns new gallery size
+     */
+    int compact(int prototypes);
+    /**
+     * pack projections into matProjections, has to be called whenever projections change
+     */
+    void build_index();
+    /**
+     * map labels to dense ids, called by build_index
+     */
+    void intern_labels();
+    /**
+     * number of training images represented by gallery entry
+     */
+    double weight(unsigned int i) const;
+    /**
+     * load and preprocess images listed in csv file, progress is called with path of every loaded image
+     */
+    static void read_csv(const string &filename, vector<Mat> &images, vector<string> &labels, char separator = ';',
+                         function<void(const string&)> progress = function<void(const string&)>());
+    /**
+     * project preprocessed face to subspace
+     */
+    Mat project(const Mat &face) const;
+    /**
+     * project batch of preprocessed faces at once, one row per face
+     */
+    Mat project(const vector<Mat> &faces) const;
+    /**
+     * find up to k nearest gallery entries of projected face, sorted by distance
+     * distances are summed in blocks of components, entry is abandoned when it cannot get into top k
+     */
+    void nearest(const Mat &target, unsigned int k, vector<Neighbour> &out, KnnStats *stats = 0) const;
+    /**
+     * reference KNN computing full distance to every gallery entry
+     */
+    void nearest_exact(const Mat &target, unsigned int k, vector<Neighbour> &out) const;
+    /**
+     * weighted vote of nearest neighbours, returns best label and optionally its mean distance
+     */
+    static string vote(const vector<Neighbour> &neighbours, double *distance = 0);
+    /**
+     * recognize preprocessed face
+     */
+    string recognize(const Mat &face) const;
+    /**
+     * reference recognition allocating on every call: subspaceProject, nearest and vote over labels
+     */
+    string recognize_reference(const Mat &face) const;
+    /**
+     * recognize preprocessed face using only buffers of scratch, returns label id or -1 for unknown
+     * once scratch has seen face of the same size, call does not allocate
+     */
+    int recognize_id(const Mat &face, RecognizeScratch &scratch, double *distance = 0) const;
+    /**
+     * label of id returned by recognize_id, "unknown" for -1
+     */
+    const string &name(int id) const;
+
+private:
+    /**
+     * k nearest entries of projected face q into caller buffers, returns number of entries found
+     */
+    unsigned int search(const float *q, unsigned int k, unsigned int *entries, double *distances,
+                        vector< pair<double, unsigned int> > &order, KnnStats *stats) const;
+};
+
+/**
+ * buffers of one recognition, reused between calls of recognize_id
+ */
+struct RecognizeScratch
+{
+    Mat gray; /** face converted to one channel */
+    Mat row; /** face as float row */
+    Mat projected; /** */
+    unsigned int entries[Recognizer::K]; /** nearest gallery entries */
+    double distances[Recognizer::K]; /** */
+    vector< pair<double, unsigned int> > order; /** coarse pass ordering */
+    vector<Weight> votes; /** vote table indexed by label id */
+};
+
+#endif // RECOGNIZER_H
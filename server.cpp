@@ -0,0 +1,385 @@
+#include "server.h"
+#include "protocol.h"
+#include "preprocessimg.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QFile>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <iostream>
+
+IdentifyServer::IdentifyServer(QObject *parent) :
+    QObject(parent),
+    server(new QLocalServer(this)),
+    deadline(new QTimer(this)),
+    statsTimer(new QTimer(this)),
+    batchSize(1),
+    deadlineMs(0),
+    maxQueue(0),
+    rejected(0),
+    batches(0),
+    batched(0)
+{
+    this->deadline->setSingleShot(true);
+    connect(this->server, SIGNAL(newConnection()), this, SLOT(new_connection()));
+    connect(this->deadline, SIGNAL(timeout()), this, SLOT(process_batch()));
+    connect(this->statsTimer, SIGNAL(timeout()), this, SLOT(print_stats()));
+}
+
+IdentifyServer::~IdentifyServer()
+{
+
+}
+
+int IdentifyServer::init(const string &csvPath)
+{
+    if(PreprocessImg::loadCascades())
+    {
+        cerr << "Error: loading cascade files" << endl;
+        return 1;
+    }
+
+    vector<Mat> images;
+    vector<string> labels;
+    cerr << "Loading train samples from " << csvPath << "..." << endl;
+    try
+    {
+        Recognizer::read_csv(csvPath, images, labels);
+    }
+    catch (Exception& e)
+    {
+        cerr << "Error opening file \"" << csvPath << "\". Reason: " << e.msg << endl;
+        return 1;
+    }
+
+    cerr << "Training on " << images.size() << " images..." << endl;
+    this->recognizer.train(images, labels, vector<int>(), -1);
+    cerr << "Training done" << endl;
+    return 0;
+}
+
+int IdentifyServer::listen(const string &name, int batchSize, int deadlineMs, int maxQueue)
+{
+    this->batchSize = batchSize > 0 ? batchSize : 1;
+    this->deadlineMs = deadlineMs > 0 ? deadlineMs : 0;
+    this->maxQueue = maxQueue > this->batchSize ? maxQueue : this->batchSize;
+
+    QLocalServer::removeServer(QString::fromStdString(name));
+    if(!this->server->listen(QString::fromStdString(name)))
+        return 1;
+    this->statsTimer->start(10000);
+    cerr << "Listening on " << name << ", batch " << this->batchSize << ", deadline " << this->deadlineMs
+         << " ms, queue " << this->maxQueue << endl;
+    return 0;
+}
+
+void IdentifyServer::new_connection()
+{
+    while(this->server->hasPendingConnections())
+    {
+        QLocalSocket *socket = this->server->nextPendingConnection();
+        this->buffers[socket] = QByteArray();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(read_request()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(client_disconnected()));
+    }
+}
+
+void IdentifyServer::read_request()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(this->sender());
+    if(!socket)
+        return;
+    QByteArray &buffer = this->buffers[socket];
+    buffer.append(socket->readAll());
+
+    QByteArray payload;
+    while(take_message(buffer, payload))
+    {
+        // request: id and encoded image
+        QDataStream in(payload);
+        quint32 id;
+        QByteArray bytes;
+        in >> id >> bytes;
+
+        if((int)this->queue.size() >= this->maxQueue)
+        { // backpressure, client should retry later
+            this->rejected++;
+            this->reply(socket, id, IDENTIFY_BUSY, vector<Rect>(), vector<string>(), vector<double>());
+            continue;
+        }
+
+        Request request;
+        request.arrived.start();
+        request.socket = socket;
+        request.id = id;
+        if(!bytes.isEmpty())
+            request.image = imdecode(Mat(1, bytes.size(), CV_8UC1, bytes.data()), CV_LOAD_IMAGE_COLOR);
+        if(request.image.empty())
+        {
+            this->reply(socket, id, IDENTIFY_BAD_IMAGE, vector<Rect>(), vector<string>(), vector<double>());
+            continue;
+        }
+        this->queue.push_back(request);
+
+        if((int)this->queue.size() >= this->batchSize)
+            this->process_batch();
+        else if(!this->deadline->isActive())
+            this->deadline->start(this->deadlineMs);
+    }
+}
+
+void IdentifyServer::client_disconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(this->sender());
+    // forget queued requests of gone client
+    for(deque<Request>::iterator itr = this->queue.begin(); itr != this->queue.end();)
+    {
+        if(itr->socket == socket)
+            itr = this->queue.erase(itr);
+        else
+            ++itr;
+    }
+    this->buffers.remove(socket);
+    if(socket)
+        socket->deleteLater();
+}
+
+void IdentifyServer::process_batch()
+{
+    this->deadline->stop();
+    if(this->queue.empty())
+        return;
+
+    unsigned int n = min((unsigned int)this->batchSize, (unsigned int)this->queue.size());
+    vector<Request> batch(this->queue.begin(), this->queue.begin() + n);
+    this->queue.erase(this->queue.begin(), this->queue.begin() + n);
+
+    // detect faces of whole batch in parallel, every pool thread uses its own cascades
+    struct Detection
+    {
+        Mat image;
+        Mat face;
+        Rect rect;
+        bool found;
+    };
+    vector<Detection> detections(batch.size());
+    for(unsigned int i = 0; i < batch.size(); i++)
+        detections[i].image = batch[i].image;
+    QtConcurrent::blockingMap(detections, [](Detection &detection) {
+        PreprocessImg img(detection.image);
+        detection.found = img.preprocess() == 0;
+        if(!detection.found)
+            return;
+        detection.face = img.imgPreprocessedFace;
+        detection.rect = img.faceRect;
+    });
+
+    vector<Mat> faces;
+    vector<Rect> rects;
+    vector<unsigned int> owners;
+    for(unsigned int i = 0; i < detections.size(); i++)
+    {
+        if(!detections[i].found)
+            continue;
+        faces.push_back(detections[i].face);
+        rects.push_back(detections[i].rect);
+        owners.push_back(i);
+    }
+
+    // project all faces by one matrix product and vote
+    vector<string> names(faces.size(), "unknown");
+    vector<double> distances(faces.size(), 0.0);
+    if(!faces.empty() && this->recognizer.labels.size() > Recognizer::K)
+    {
+        Mat projected = this->recognizer.project(faces);
+        vector<Neighbour> neighbours;
+        for(int r = 0; r < projected.rows; r++)
+        {
+            this->recognizer.nearest(projected.row(r), Recognizer::K, neighbours);
+            names[r] = Recognizer::vote(neighbours, &distances[r]);
+        }
+    }
+
+    for(unsigned int i = 0; i < batch.size(); i++)
+    {
+        vector<Rect> replyRects;
+        vector<string> replyNames;
+        vector<double> replyDistances;
+        for(unsigned int f = 0; f < owners.size(); f++)
+        {
+            if(owners[f] != i)
+                continue;
+            replyRects.push_back(rects[f]);
+            replyNames.push_back(names[f]);
+            replyDistances.push_back(distances[f]);
+        }
+        this->reply(batch[i].socket, batch[i].id, IDENTIFY_OK, replyRects, replyNames, replyDistances);
+        this->latency.record(batch[i].arrived.nsecsElapsed() / 1000);
+    }
+    this->batches++;
+    this->batched += batch.size();
+
+    // let event loop read new requests before the next batch
+    if(!this->queue.empty())
+    {
+        int waited = (int)this->queue.front().arrived.elapsed();
+        if((int)this->queue.size() >= this->batchSize || waited >= this->deadlineMs)
+            this->deadline->start(0);
+        else
+            this->deadline->start(this->deadlineMs - waited);
+    }
+}
+
+void IdentifyServer::print_stats()
+{
+    if(this->latency.count() == 0)
+        return;
+    cerr << "Batches " << this->batches << ", mean batch " << this->batched / (double)this->batches
+         << ", rejected " << this->rejected << ", queued " << this->queue.size() << endl;
+    cerr << "Latency: " << this->latency.report() << endl;
+}
+
+void IdentifyServer::reply(QLocalSocket *socket, quint32 id, IdentifyStatus status, const vector<Rect> &faces,
+                           const vector<string> &labels, const vector<double> &distances)
+{
+    // reply: id, status and (face rectangle, label, distance) of every face
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out << id << (quint8)status << (quint32)faces.size();
+    for(unsigned int i = 0; i < faces.size(); i++)
+    {
+        out << (qint32)faces[i].x << (qint32)faces[i].y << (qint32)faces[i].width << (qint32)faces[i].height;
+        out << QString::fromStdString(labels[i]) << distances[i];
+    }
+    write_message(socket, payload);
+}
+
+LoadGenerator::LoadGenerator(QObject *parent) :
+    QObject(parent),
+    pacer(new QTimer(this)),
+    requests(0),
+    rate(0),
+    issued(0),
+    done(0),
+    busy(0)
+{
+    connect(this->pacer, SIGNAL(timeout()), this, SLOT(send_due()));
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    for(unsigned int i = 0; i < this->sockets.size(); i++)
+        delete this->sockets[i];
+}
+
+int LoadGenerator::start(const string &name, const string &imagePath, int requests, int concurrency, int rate)
+{
+    QFile file(QString::fromStdString(imagePath));
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        cerr << "Error: cannot read " << imagePath << endl;
+        return 1;
+    }
+    this->image = file.readAll();
+    this->requests = requests;
+    this->rate = rate > 0 ? rate : 0;
+    if(requests <= 0 || concurrency <= 0)
+        return 1;
+
+    for(int i = 0; i < concurrency; i++)
+    {
+        QLocalSocket *socket = new QLocalSocket();
+        socket->connectToServer(QString::fromStdString(name));
+        if(!socket->waitForConnected(1000))
+        {
+            cerr << "Error: cannot connect to " << name << endl;
+            delete socket;
+            return 1;
+        }
+        connect(socket, SIGNAL(readyRead()), this, SLOT(read_reply()));
+        this->sockets.push_back(socket);
+    }
+
+    this->clock.start();
+    if(this->rate > 0)
+    { // open loop, requests are sent on schedule whether replies came back or not
+        this->pacer->start(1);
+        return 0;
+    }
+    for(unsigned int i = 0; i < this->sockets.size(); i++)
+        this->send(this->sockets[i]);
+    return 0;
+}
+
+void LoadGenerator::send(QLocalSocket *socket)
+{
+    if(this->issued >= this->requests)
+        return;
+    this->issued++;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out << (quint32)this->issued << this->image;
+    this->sent[this->issued].start();
+    write_message(socket, payload);
+}
+
+void LoadGenerator::send_due()
+{
+    // catch up with schedule, requests are dealt round robin over connections
+    qint64 due = min((qint64)this->requests, this->rate * this->clock.elapsed() / 1000 + 1);
+    while(this->issued < due)
+        this->send(this->sockets[this->issued % this->sockets.size()]);
+    if(this->issued >= this->requests)
+        this->pacer->stop();
+}
+
+void LoadGenerator::read_reply()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(this->sender());
+    if(!socket)
+        return;
+    QByteArray &buffer = this->buffers[socket];
+    buffer.append(socket->readAll());
+
+    QByteArray payload;
+    while(take_message(buffer, payload))
+    {
+        QDataStream in(payload);
+        quint32 id;
+        quint8 status;
+        in >> id >> status;
+        // fast rejections would hide queueing delay of served requests, so they are kept apart
+        qint64 us = this->sent.take(id).nsecsElapsed() / 1000;
+        if(status == IDENTIFY_BUSY)
+        {
+            this->busy++;
+            this->rejectLatency.record(us);
+        }
+        else
+        {
+            this->latency.record(us);
+        }
+        this->done++;
+
+        if(this->done >= this->requests)
+        {
+            double seconds = this->clock.nsecsElapsed() / 1e9;
+            cerr << "Sent " << this->done << " requests over " << this->sockets.size() << " connections in "
+                 << seconds << " s => " << this->done / seconds << " req/s, served "
+                 << (this->done - this->busy) / seconds << " req/s";
+            if(this->rate > 0)
+                cerr << ", open loop at " << this->rate << " req/s";
+            cerr << endl;
+            cerr << "Served latency: " << this->latency.report() << ", rejected " << this->busy << " ("
+                 << 100.0 * this->busy / this->done << "%)" << endl;
+            if(this->busy > 0)
+                cerr << "Rejection latency: " << this->rejectLatency.report() << endl;
+            QCoreApplication::quit();
+            return;
+        }
+        if(this->rate == 0)
+            this->send(socket);
+    }
+}
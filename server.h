@@ -0,0 +1,123 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <QObject>
+#include <QMap>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTimer>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "recognizer.h"
+#include "histogram.h"
+
+using namespace std;
+
+/**
+ * status of identification reply
+ */
+enum IdentifyStatus
+{
+    IDENTIFY_OK = 0,
+    IDENTIFY_BUSY = 1, /** request rejected, server queue is full */
+    IDENTIFY_BAD_IMAGE = 2 /** image bytes cannot be decoded */
+};
+
+/**
+ * long running identification daemon, requests are processed in micro-batches
+ */
+class IdentifyServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit IdentifyServer(QObject *parent = 0);
+    ~IdentifyServer();
+    /**
+     * load cascades and train model once, returns 0 on success
+     */
+    int init(const string &csvPath);
+    /**
+     * start listening, batch is processed when full or when its oldest request waited deadlineMs
+     */
+    int listen(const string &name, int batchSize, int deadlineMs, int maxQueue);
+
+private slots:
+    void new_connection();
+    void read_request();
+    void client_disconnected();
+    void process_batch();
+    void print_stats();
+
+private:
+    struct Request
+    {
+        QLocalSocket *socket;
+        quint32 id;
+        Mat image;
+        QElapsedTimer arrived;
+    };
+
+    QLocalServer *server; /** */
+    QTimer *deadline; /** fires when oldest queued request has to be processed */
+    QTimer *statsTimer; /** */
+    QMap<QLocalSocket*, QByteArray> buffers; /** unfinished requests of connected clients */
+    deque<Request> queue; /** requests waiting for batch */
+    Recognizer recognizer; /** */
+    int batchSize; /** */
+    int deadlineMs; /** */
+    int maxQueue; /** queue length over which requests are rejected */
+    LatencyHistogram latency; /** request latency from arrival to reply */
+    qint64 rejected; /** */
+    qint64 batches; /** */
+    qint64 batched; /** requests processed in batches */
+
+    void reply(QLocalSocket *socket, quint32 id, IdentifyStatus status, const vector<Rect> &faces,
+               const vector<string> &labels, const vector<double> &distances);
+};
+
+/**
+ * load generator for identification daemon, closed loop or open loop at fixed request rate
+ */
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LoadGenerator(QObject *parent = 0);
+    ~LoadGenerator();
+    /**
+     * send requests image over concurrency connections
+     * with rate 0 each connection keeps one request in flight, otherwise rate requests per second
+     * are sent regardless of replies, so the server queue can overflow
+     */
+    int start(const string &name, const string &imagePath, int requests, int concurrency, int rate = 0);
+
+private slots:
+    void read_reply();
+    void send_due();
+
+private:
+    vector<QLocalSocket*> sockets; /** */
+    QMap<QLocalSocket*, QByteArray> buffers; /** */
+    QMap<quint32, QElapsedTimer> sent; /** send time of requests in flight by id */
+    QTimer *pacer; /** sends due requests in open loop mode */
+    QByteArray image; /** encoded image sent with every request */
+    int requests; /** requests to send in total */
+    qint64 rate; /** requests per second in open loop mode, 0 for closed loop */
+    int issued; /** */
+    int done; /** */
+    qint64 busy; /** */
+    QElapsedTimer clock; /** */
+    LatencyHistogram latency; /** served requests only */
+    LatencyHistogram rejectLatency; /** requests rejected with IDENTIFY_BUSY */
+
+    void send(QLocalSocket *socket);
+};
+
+#endif // SERVER_H
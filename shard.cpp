@@ -0,0 +1,356 @@
+#include "shard.h"
+#include "protocol.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+
+#include <algorithm>
+#include <map>
+
+static bool closer(const Neighbour &a, const Neighbour &b)
+{
+    return a.distance < b.distance;
+}
+
+ShardWorker::ShardWorker(QObject *parent) :
+    QObject(parent),
+    server(new QLocalServer(this))
+{
+    connect(this->server, SIGNAL(newConnection()), this, SLOT(new_connection()));
+}
+
+ShardWorker::~ShardWorker()
+{
+
+}
+
+int ShardWorker::listen(const string &name, const string &galleryPath)
+{
+    QFile file(QString::fromStdString(galleryPath));
+    if(!file.open(QIODevice::ReadOnly))
+        return 1;
+
+    // gallery file: number of rows, dimensionality and (label, weight, row) triples
+    QDataStream in(&file);
+    quint32 rows, cols;
+    in >> rows >> cols;
+    for(quint32 i = 0; i < rows; i++)
+    {
+        QString label;
+        double weight;
+        Mat row(1, cols, CV_32FC1);
+        in >> label >> weight;
+        in.readRawData((char *)row.data, cols*sizeof(float));
+        this->gallery.labels.push_back(label.toStdString());
+        this->gallery.weights.push_back(weight);
+        this->gallery.projections.push_back(row);
+    }
+    if(in.status() != QDataStream::Ok)
+        return 1;
+    this->gallery.build_index();
+
+    QLocalServer::removeServer(QString::fromStdString(name));
+    if(!this->server->listen(QString::fromStdString(name)))
+        return 1;
+    return 0;
+}
+
+void ShardWorker::new_connection()
+{
+    while(this->server->hasPendingConnections())
+    {
+        QLocalSocket *socket = this->server->nextPendingConnection();
+        this->buffers[socket] = QByteArray();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(read_request()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(client_disconnected()));
+    }
+}
+
+void ShardWorker::read_request()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(this->sender());
+    if(!socket)
+        return;
+    QByteArray &buffer = this->buffers[socket];
+    buffer.append(socket->readAll());
+
+    QByteArray payload;
+    while(take_message(buffer, payload))
+    {
+        // request: id, k, dimensionality and projected face
+        QDataStream in(payload);
+        quint32 id, k, cols;
+        in >> id >> k >> cols;
+        Mat target(1, cols, CV_32FC1);
+        in.readRawData((char *)target.data, cols*sizeof(float));
+
+        vector<Neighbour> neighbours;
+        if(!this->gallery.projections.empty() && (int)cols == this->gallery.projections[0].cols)
+            this->gallery.nearest(target, k, neighbours);
+
+        // reply: id and neighbours found on this shard
+        QByteArray reply;
+        QDataStream out(&reply, QIODevice::WriteOnly);
+        out << id << (quint32)neighbours.size();
+        for(unsigned int i = 0; i < neighbours.size(); i++)
+            out << QString::fromStdString(neighbours[i].label) << neighbours[i].distance << neighbours[i].weight;
+        write_message(socket, reply);
+    }
+}
+
+void ShardWorker::client_disconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(this->sender());
+    this->buffers.remove(socket);
+    if(socket)
+        socket->deleteLater();
+    // worker lives only as long as its coordinator
+    if(this->buffers.isEmpty())
+        QCoreApplication::quit();
+}
+
+ShardCoordinator::ShardCoordinator() :
+    timeoutMs(0),
+    requestId(0),
+    lastAnswered(0),
+    ready(false)
+{
+
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+    this->stop();
+}
+
+int ShardCoordinator::start(const Recognizer &model, int shardCount, Assignment assignment, int timeoutMs)
+{
+    this->stop();
+    if(shardCount <= 0 || model.projections.empty())
+        return 1;
+    this->timeoutMs = timeoutMs;
+
+    // assign gallery entries to shards
+    vector<int> shardOf(model.projections.size());
+    map<string,int> identities;
+    for(unsigned int i = 0; i < model.projections.size(); i++)
+    {
+        if(assignment == BY_IDENTITY)
+        { // identities are dealt round robin in order of first occurence
+            map<string,int>::iterator itr = identities.find(model.labels[i]);
+            if(itr == identities.end())
+            {
+                int shard = identities.size() % shardCount;
+                itr = identities.insert(make_pair(model.labels[i], shard)).first;
+            }
+            shardOf[i] = itr->second;
+        }
+        else
+        { // multiplicative hash of gallery index
+            shardOf[i] = (int)(((quint32)i * 2654435761u) % (quint32)shardCount);
+        }
+    }
+
+    QString program = QCoreApplication::applicationFilePath();
+    qint64 pid = QCoreApplication::applicationPid();
+    int cols = model.projections[0].cols;
+    for(int s = 0; s < shardCount; s++)
+    {
+        QString name = QString("pov-shard-%1-%2").arg(pid).arg(s);
+        QString path = QDir::temp().filePath(name + ".bin");
+
+        // write part of gallery for this shard
+        QFile file(path);
+        if(!file.open(QIODevice::WriteOnly))
+        {
+            this->stop();
+            return 1;
+        }
+        quint32 rows = count(shardOf.begin(), shardOf.end(), s);
+        QDataStream out(&file);
+        out << rows << (quint32)cols;
+        for(unsigned int i = 0; i < model.projections.size(); i++)
+        {
+            if(shardOf[i] != s)
+                continue;
+            Mat row;
+            model.projections[i].reshape(1, 1).convertTo(row, CV_32FC1);
+            out << QString::fromStdString(model.labels[i]) << model.weight(i);
+            out.writeRawData((const char *)row.data, cols*sizeof(float));
+        }
+        file.close();
+        this->galleryFiles.push_back(path.toStdString());
+
+        QProcess *worker = new QProcess();
+        worker->setProcessChannelMode(QProcess::ForwardedChannels);
+        worker->start(program, QStringList() << "--shard" << name << path);
+        this->workers.push_back(worker);
+
+        this->sockets.push_back(new QLocalSocket());
+        this->names.push_back(name);
+        this->buffers.push_back(QByteArray());
+    }
+
+    // workers need a while to load their gallery before they listen, caller keeps working meanwhile
+    this->connect_workers();
+    return 0;
+}
+
+bool ShardCoordinator::connect_workers()
+{
+    if(this->ready)
+        return true;
+    bool all = !this->sockets.empty();
+    for(unsigned int s = 0; s < this->sockets.size(); s++)
+    {
+        QLocalSocket *socket = this->sockets[s];
+        if(socket->state() == QLocalSocket::UnconnectedState)
+            socket->connectToServer(this->names[s]);
+        if(socket->state() == QLocalSocket::ConnectingState)
+            socket->waitForConnected(0);
+        all = all && socket->state() == QLocalSocket::ConnectedState;
+    }
+    this->ready = all;
+    return all;
+}
+
+bool ShardCoordinator::wait_ready(int timeoutMs)
+{
+    QElapsedTimer clock;
+    clock.start();
+    while(!this->connect_workers())
+    {
+        if(clock.elapsed() >= timeoutMs)
+            return false;
+        QThread::msleep(20);
+    }
+    return true;
+}
+
+void ShardCoordinator::kill_worker(int shard)
+{
+    if(shard < 0 || shard >= (int)this->workers.size())
+        return;
+    this->workers[shard]->kill();
+    this->workers[shard]->waitForFinished(1000);
+}
+
+void ShardCoordinator::stop()
+{
+    for(unsigned int s = 0; s < this->sockets.size(); s++)
+    {
+        this->sockets[s]->abort();
+        delete this->sockets[s];
+    }
+    for(unsigned int s = 0; s < this->workers.size(); s++)
+    {
+        this->workers[s]->kill();
+        this->workers[s]->waitForFinished(1000);
+        delete this->workers[s];
+    }
+    for(unsigned int s = 0; s < this->galleryFiles.size(); s++)
+        QFile::remove(QString::fromStdString(this->galleryFiles[s]));
+
+    this->sockets.clear();
+    this->names.clear();
+    this->workers.clear();
+    this->buffers.clear();
+    this->galleryFiles.clear();
+    this->lastAnswered = 0;
+    this->ready = false;
+}
+
+bool ShardCoordinator::isRunning() const
+{
+    return !this->sockets.empty();
+}
+
+bool ShardCoordinator::isReady() const
+{
+    return this->ready;
+}
+
+int ShardCoordinator::answered() const
+{
+    return this->lastAnswered;
+}
+
+int ShardCoordinator::shardCount() const
+{
+    return this->sockets.size();
+}
+
+bool ShardCoordinator::take_reply(QByteArray &buffer, vector<Neighbour> &out)
+{
+    QByteArray payload;
+    while(take_message(buffer, payload))
+    {
+        QDataStream in(payload);
+        quint32 id, n;
+        in >> id >> n;
+        if(id != this->requestId)
+            continue; // late reply to query which already timed out
+        for(quint32 i = 0; i < n; i++)
+        {
+            QString label;
+            Neighbour neighbour;
+            in >> label >> neighbour.distance >> neighbour.weight;
+            neighbour.label = label.toStdString();
+            out.push_back(neighbour);
+        }
+        return true;
+    }
+    return false;
+}
+
+void ShardCoordinator::nearest(const Mat &target, unsigned int k, vector<Neighbour> &out)
+{
+    out.clear();
+    this->lastAnswered = 0;
+
+    Mat row;
+    target.reshape(1, 1).convertTo(row, CV_32FC1);
+    this->requestId++;
+    QByteArray request;
+    QDataStream stream(&request, QIODevice::WriteOnly);
+    stream << this->requestId << (quint32)k << (quint32)row.cols;
+    stream.writeRawData((const char *)row.data, row.cols*sizeof(float));
+
+    // scatter projected face to all shards
+    for(unsigned int s = 0; s < this->sockets.size(); s++)
+    {
+        if(this->sockets[s]->state() == QLocalSocket::ConnectedState)
+            write_message(this->sockets[s], request);
+    }
+
+    // gather partial results, slow or missing shards are skipped after timeout
+    QElapsedTimer clock;
+    clock.start();
+    for(unsigned int s = 0; s < this->sockets.size(); s++)
+    {
+        QLocalSocket *socket = this->sockets[s];
+        if(socket->state() != QLocalSocket::ConnectedState)
+            continue;
+        for(;;)
+        {
+            this->buffers[s].append(socket->readAll());
+            if(this->take_reply(this->buffers[s], out))
+            {
+                this->lastAnswered++;
+                break;
+            }
+            int remaining = this->timeoutMs - (int)clock.elapsed();
+            if(remaining <= 0 || !socket->waitForReadyRead(remaining))
+                break;
+        }
+    }
+
+    // merge per shard top-k
+    sort(out.begin(), out.end(), closer);
+    if(out.size() > k)
+        out.resize(k);
+}
@@ -0,0 +1,108 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <QObject>
+#include <QMap>
+#include <QByteArray>
+#include <QProcess>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+#include <string>
+#include <vector>
+
+#include "recognizer.h"
+
+using namespace std;
+
+/**
+ * worker process serving KNN queries over one part of the gallery
+ */
+class ShardWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ShardWorker(QObject *parent = 0);
+    ~ShardWorker();
+    /**
+     * load gallery file and start listening on local socket, returns 0 on success
+     */
+    int listen(const string &name, const string &galleryPath);
+
+private slots:
+    void new_connection();
+    void read_request();
+    void client_disconnected();
+
+private:
+    QLocalServer *server; /** */
+    QMap<QLocalSocket*, QByteArray> buffers; /** unfinished requests of connected clients */
+    Recognizer gallery; /** only projections and labels are filled in */
+};
+
+/**
+ * spawns shard workers and scatters KNN queries over them
+ */
+class ShardCoordinator
+{
+public:
+    enum Assignment
+    {
+        BY_IDENTITY, /** all images of one identity live on the same shard */
+        BY_HASH /** images are spread by hash of their gallery index */
+    };
+
+    ShardCoordinator();
+    ~ShardCoordinator();
+    /**
+     * partition gallery of trained model and start worker processes, returns 0 on success
+     * does not wait for workers, they are connected by connect_workers once they listen
+     */
+    int start(const Recognizer &model, int shardCount, Assignment assignment, int timeoutMs);
+    /**
+     * try to connect workers which are not connected yet without blocking, returns true once all of them connected
+     */
+    bool connect_workers();
+    /**
+     * call connect_workers until all workers are connected or timeout expires, returns true if they are
+     */
+    bool wait_ready(int timeoutMs);
+    /**
+     * kill worker process of one shard, its queries then end in the missing shard path
+     */
+    void kill_worker(int shard);
+    /**
+     * stop workers and remove their gallery files
+     */
+    void stop();
+    bool isRunning() const;
+    /**
+     * every worker has connected since start
+     */
+    bool isReady() const;
+    /**
+     * number of shards which answered the last query in time
+     */
+    int answered() const;
+    int shardCount() const;
+    /**
+     * merged k nearest neighbours over all shards which answered within timeout
+     */
+    void nearest(const Mat &target, unsigned int k, vector<Neighbour> &out);
+
+private:
+    vector<QProcess*> workers; /** */
+    vector<QLocalSocket*> sockets; /** */
+    vector<QString> names; /** socket names of workers */
+    vector<QByteArray> buffers; /** unfinished replies of shards */
+    vector<string> galleryFiles; /** */
+    int timeoutMs; /** how long to wait for slow shards */
+    quint32 requestId; /** id of last query, replies to older ones are dropped */
+    int lastAnswered; /** */
+    bool ready; /** */
+
+    bool take_reply(QByteArray &buffer, vector<Neighbour> &out);
+};
+
+#endif // SHARD_H
@@ -0,0 +1,59 @@
+#include "synthetic.h"
+
+#include <math.h>
+
+static const double IDENTITY_SPREAD = 0.5; /** perturbation of real face in SYNTH_PERTURBED, in standard deviations */
+static const double IMAGE_SPREAD = 0.3; /** spread of images of one identity around its centre */
+
+void synth_gallery(const Recognizer &base, SynthMode mode, int entries, int imagesPerIdentity, int dims,
+                   unsigned int seed, Recognizer &out)
+{
+    out.clear();
+    if(base.matProjections.empty() || entries <= 0)
+        return;
+    dims = min(dims > 0 ? dims : base.matProjections.cols, base.matProjections.cols);
+    imagesPerIdentity = max(imagesPerIdentity, 1);
+
+    // keep projection of real faces, only with leading components
+    out.mean = base.mean.clone();
+    out.transposedEV = base.transposedEV.colRange(0, dims).clone();
+    base.eugenVal.rowRange(0, dims).convertTo(out.eugenVal, CV_32FC1);
+    out.coarseDims = base.coarseDims;
+
+    // standard deviation of every component
+    Mat sigma(1, dims, CV_32FC1);
+    for(int d = 0; d < dims; d++)
+        sigma.at<float>(0, d) = (float)sqrt(max(0.0f, out.eugenVal.at<float>(d)));
+
+    // rows are written straight into the index and projections stay empty, at 10M entries their Mat headers
+    // alone would take about 1 GB; every entry still keeps its label string (32 bytes for short labels)
+    RNG rng(seed);
+    Mat rows(entries, dims, CV_32FC1);
+    Mat centre(1, dims, CV_32FC1);
+    Mat noise(1, dims, CV_32FC1);
+    out.labels.resize(entries);
+    string label;
+    for(int i = 0; i < entries; i++)
+    {
+        if(i % imagesPerIdentity == 0)
+        {
+            rng.fill(noise, RNG::NORMAL, 0.0, 1.0);
+            if(mode == SYNTH_PERTURBED)
+            {
+                int real = rng.uniform(0, base.matProjections.rows);
+                centre = base.matProjections.row(real).colRange(0, dims) + noise.mul(sigma, IDENTITY_SPREAD);
+            }
+            else
+            {
+                centre = noise.mul(sigma);
+            }
+            label = "synth"+to_string(i / imagesPerIdentity);
+        }
+        rng.fill(noise, RNG::NORMAL, 0.0, 1.0);
+        Mat row = rows.row(i);
+        row = centre + noise.mul(sigma, IMAGE_SPREAD);
+        out.labels[i] = label;
+    }
+    out.matProjections = rows;
+    out.intern_labels();
+}
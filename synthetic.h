@@ -0,0 +1,26 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include "recognizer.h"
+
+using namespace std;
+
+/**
+ * how synthetic identities are drawn
+ */
+enum SynthMode
+{
+    SYNTH_RANDOM, /** random points with eigenvalue decay of trained model */
+    SYNTH_PERTURBED /** perturbed copies of real training faces */
+};
+
+/**
+ * gallery of given size for scaling tests, far beyond bundled datasets
+ * out gets PCA of base truncated to dims leading components and entries synthetic projections,
+ * imagesPerIdentity entries per identity, so real faces can still be projected and recognized against it
+ * only matProjections is filled, projections stay empty, so nearest_exact, compact and shards cannot be used on out
+ */
+void synth_gallery(const Recognizer &base, SynthMode mode, int entries, int imagesPerIdentity, int dims,
+                   unsigned int seed, Recognizer &out);
+
+#endif // SYNTHETIC_H
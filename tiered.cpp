@@ -0,0 +1,385 @@
+#include "tiered.h"
+
+#include <QtGlobal>
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_WIN
+#ifndef NOMINMAX
+#define NOMINMAX // std::min and std::max are used below
+#endif
+#include <windows.h>
+
+// PrefetchVirtualMemory exists since Windows 8 and is missing in older MinGW headers, so it is looked up at run time
+struct PrefetchRange
+{
+    void *address;
+    SIZE_T bytes;
+};
+typedef BOOL (WINAPI *PrefetchFunction)(HANDLE process, ULONG_PTR count, PrefetchRange *ranges, ULONG flags);
+
+static PrefetchFunction prefetch_function()
+{
+    static PrefetchFunction function = (PrefetchFunction)GetProcAddress(GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory");
+    return function;
+}
+
+static long page_size()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+}
+#endif
+
+// squared distance, summing stops after the block in which it reached limit
+static double partial_distance(const float *row, const float *q, int dims, double limit)
+{
+    double distance = 0.0;
+    int d = 0;
+    while(d < dims && distance < limit)
+    {
+        int end = min(d + Recognizer::BLOCK, dims);
+        for(; d < end; d++)
+        {
+            double diff = row[d] - q[d];
+            distance += diff * diff;
+        }
+    }
+    return distance;
+}
+
+// insert into top k sorted by distance, if it belongs there
+static void insert(double distance, unsigned int entry, unsigned int k, vector<double> &distances, vector<unsigned int> &entries)
+{
+    for(unsigned int j = 0; j < k; j++)
+    {
+        if(distance < distances[j])
+        {
+            //discard the worst match and shift remaining down
+            for(unsigned int l = k-1; l > j; l--)
+            {
+                distances[l] = distances[l-1];
+                entries[l] = entries[l-1];
+            }
+            entries[j] = entry;
+            distances[j] = distance;
+            return;
+        }
+    }
+}
+
+TieredGallery::TieredGallery() :
+    dims(0),
+    cold(0),
+    hot(0),
+    stride(0),
+    budget(0),
+    queries(0),
+    coldRead(0)
+{
+
+}
+
+TieredGallery::~TieredGallery()
+{
+    this->close();
+}
+
+int TieredGallery::build(const Recognizer &model, const string &path, size_t ramBudget)
+{
+    this->close();
+    if(model.matProjections.empty())
+        return 1;
+    this->dims = model.matProjections.cols;
+    this->stride = (this->dims * sizeof(float) + ALIGN - 1) / ALIGN * ALIGN / sizeof(float);
+    this->budget = ramBudget;
+
+    // rows of one identity are stored together, so it is read or skipped as one range
+    map<string, vector<unsigned int> > members;
+    for(unsigned int i = 0; i < model.labels.size(); i++)
+        members[model.labels[i]].push_back(i);
+
+    this->file.setFileName(QString::fromStdString(path));
+    if(!this->file.open(QIODevice::ReadWrite | QIODevice::Truncate))
+        return 1;
+    this->centroids.create(members.size(), this->dims, CV_32FC1);
+    unsigned int row = 0;
+    for(map<string, vector<unsigned int> >::iterator itr = members.begin(); itr != members.end(); ++itr)
+    {
+        const vector<unsigned int> &idx = itr->second;
+        Identity identity;
+        identity.label = itr->first;
+        identity.first = row;
+        identity.count = idx.size();
+        identity.score = 0.0;
+        identity.hotRow = -1;
+
+        Mat rows(idx.size(), this->dims, CV_32FC1);
+        for(unsigned int r = 0; r < idx.size(); r++)
+        {
+            model.matProjections.row(idx[r]).copyTo(rows.row(r));
+            this->weights.push_back(model.weight(idx[r]));
+        }
+        Mat centroid = this->centroids.row(this->identities.size());
+        reduce(rows, centroid, 0, CV_REDUCE_AVG, CV_32FC1);
+
+        // radius is measured from stored float centroid and widened a bit, so bound never cuts a true neighbour
+        double radius = 0.0;
+        for(int r = 0; r < rows.rows; r++)
+            radius = max(radius, norm(rows.row(r), centroid, NORM_L2));
+        identity.radius = (float)(radius * (1.0 + 1e-5) + 1e-6);
+
+        if(this->file.write((const char *)rows.data, rows.total() * sizeof(float)) != (qint64)(rows.total() * sizeof(float)))
+        {
+            this->close();
+            return 1;
+        }
+        this->identities.push_back(identity);
+        row += idx.size();
+    }
+    this->file.flush();
+
+    this->cold = (const float *)this->file.map(0, this->file.size());
+    if(!this->cold)
+    {
+        this->close();
+        return 1;
+    }
+#ifdef Q_OS_UNIX
+    // no read-ahead around random cold ranges, ranges which will be scanned are announced per query
+    madvise((void *)this->cold, this->file.size(), MADV_RANDOM);
+#endif
+    // Windows has no such hint for a mapped view, its fault clustering stays and ranges are prefetched per query
+    return 0;
+}
+
+void TieredGallery::close()
+{
+    if(this->cold)
+        this->file.unmap((uchar *)this->cold);
+    if(this->file.isOpen())
+    {
+        this->file.close();
+        this->file.remove();
+    }
+    this->cold = 0;
+    this->hot = 0;
+    this->hotBuffer.clear();
+    this->identities.clear();
+    this->weights.clear();
+    this->centroids = Mat();
+    this->queries = 0;
+    this->coldRead = 0;
+}
+
+void TieredGallery::setBudget(size_t bytes)
+{
+    this->budget = bytes;
+}
+
+void TieredGallery::reset()
+{
+    for(unsigned int i = 0; i < this->identities.size(); i++)
+    {
+        this->identities[i].score = 0.0;
+        this->identities[i].hotRow = -1;
+    }
+    this->hot = 0;
+    vector<unsigned char>().swap(this->hotBuffer);
+    this->queries = 0;
+    this->coldRead = 0;
+}
+
+void TieredGallery::advise(unsigned int first, unsigned int count) const
+{
+#ifdef Q_OS_UNIX
+    static const long page = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)(this->cold + (size_t)first * this->dims);
+    uintptr_t end = (uintptr_t)(this->cold + (size_t)(first + count) * this->dims);
+    begin -= begin % page;
+    madvise((void *)begin, end - begin, MADV_WILLNEED);
+#elif defined(Q_OS_WIN)
+    static const long page = page_size();
+    uintptr_t begin = (uintptr_t)(this->cold + (size_t)first * this->dims);
+    uintptr_t end = (uintptr_t)(this->cold + (size_t)(first + count) * this->dims);
+    begin -= begin % page;
+    PrefetchFunction prefetch = prefetch_function();
+    PrefetchRange range = { (void *)begin, (SIZE_T)(end - begin) };
+    if(!prefetch || !prefetch(GetCurrentProcess(), 1, &range, 0))
+    { // fault the pages in now, one read per page instead of one fault per page during the scan
+        volatile float sink = 0.0f;
+        for(uintptr_t p = begin; p < end; p += page)
+            sink += *(const volatile float *)p;
+    }
+#else
+    Q_UNUSED(first);
+    Q_UNUSED(count);
+#endif
+}
+
+string TieredGallery::readAhead()
+{
+#if defined(Q_OS_UNIX)
+    return "madvise MADV_WILLNEED";
+#elif defined(Q_OS_WIN)
+    return prefetch_function() ? "PrefetchVirtualMemory" : "page touching";
+#else
+    return "none";
+#endif
+}
+
+void TieredGallery::nearest(const Mat &target, unsigned int k, vector<Neighbour> &out)
+{
+    out.clear();
+    if(!this->cold || k == 0)
+        return;
+
+    Mat query;
+    target.reshape(1, 1).convertTo(query, CV_32FC1);
+    const float *q = query.ptr<float>(0);
+    vector<unsigned int> entries(k, 0);
+    vector<double> distances(k, DBL_MAX);
+
+    // hot identities first, they are the likely winners and tighten the bound for cold ones
+    vector< pair<double, unsigned int> > candidates;
+    for(unsigned int i = 0; i < this->identities.size(); i++)
+    {
+        const Identity &identity = this->identities[i];
+        if(identity.hotRow < 0)
+        {
+            double centre = norm(this->centroids.row(i), query, NORM_L2);
+            double bound = max(0.0, centre - identity.radius);
+            candidates.push_back(make_pair(bound * bound, i));
+            continue;
+        }
+        for(unsigned int r = 0; r < identity.count; r++)
+        {
+            double distance = partial_distance(this->hot + (size_t)(identity.hotRow + r) * this->stride, q, this->dims, distances[k-1]);
+            if(distance < distances[k-1])
+                insert(distance, identity.first + r, k, distances, entries);
+        }
+    }
+
+    // cold identities by lower bound, scan stops once no bound can beat top k
+    sort(candidates.begin(), candidates.end());
+    unsigned int advised = 0;
+    for(unsigned int c = 0; c < candidates.size() && candidates[c].first < distances[k-1]; c++)
+    {
+        if(c >= advised)
+        { // announce next ranges which pass current bound, kernel reads them while earlier ones are scanned
+            for(advised = c; advised < candidates.size() && advised < c + 16 && candidates[advised].first < distances[k-1]; advised++)
+            {
+                const Identity &identity = this->identities[candidates[advised].second];
+                this->advise(identity.first, identity.count);
+            }
+        }
+        const Identity &identity = this->identities[candidates[c].second];
+        for(unsigned int r = 0; r < identity.count; r++)
+        {
+            double distance = partial_distance(this->cold + (size_t)(identity.first + r) * this->dims, q, this->dims, distances[k-1]);
+            if(distance < distances[k-1])
+                insert(distance, identity.first + r, k, distances, entries);
+        }
+        this->coldRead += identity.count;
+    }
+
+    unsigned int found = min(k, (unsigned int)this->weights.size());
+    for(unsigned int j = 0; j < found; j++)
+    {
+        // row in file back to its identity
+        unsigned int lo = 0, hi = this->identities.size();
+        while(hi - lo > 1)
+        {
+            unsigned int mid = (lo + hi) / 2;
+            if(this->identities[mid].first <= entries[j])
+                lo = mid;
+            else
+                hi = mid;
+        }
+        if(j == 0)
+            this->identities[lo].score += 1.0;
+
+        Neighbour neighbour;
+        neighbour.label = this->identities[lo].label;
+        neighbour.distance = sqrt(distances[j]);
+        neighbour.weight = this->weights[entries[j]];
+        out.push_back(neighbour);
+    }
+
+    this->queries++;
+    if(this->queries % REBALANCE_QUERIES == 0)
+        this->rebalance();
+}
+
+void TieredGallery::rebalance()
+{
+    // most often winning identities, until their rows fill budget
+    vector< pair<double, unsigned int> > ranking;
+    for(unsigned int i = 0; i < this->identities.size(); i++)
+    {
+        if(this->identities[i].score > 0.0)
+            ranking.push_back(make_pair(-this->identities[i].score, i));
+    }
+    sort(ranking.begin(), ranking.end());
+
+    size_t rowBytes = this->stride * sizeof(float);
+    size_t rows = 0;
+    vector<unsigned int> promoted;
+    for(unsigned int n = 0; n < ranking.size(); n++)
+    {
+        const Identity &identity = this->identities[ranking[n].second];
+        if((rows + identity.count) * rowBytes > this->budget)
+            continue;
+        rows += identity.count;
+        promoted.push_back(ranking[n].second);
+    }
+
+    // hot block is rebuilt from mapped rows, demoted identities just fall back to file
+    vector<unsigned char> buffer(rows * rowBytes + ALIGN);
+    float *block = (float *)alignPtr(&buffer[0], ALIGN);
+    for(unsigned int i = 0; i < this->identities.size(); i++)
+        this->identities[i].hotRow = -1;
+    int row = 0;
+    for(unsigned int n = 0; n < promoted.size(); n++)
+    {
+        Identity &identity = this->identities[promoted[n]];
+        for(unsigned int r = 0; r < identity.count; r++)
+            memcpy(block + (size_t)(row + r) * this->stride, this->cold + (size_t)(identity.first + r) * this->dims, this->dims * sizeof(float));
+        identity.hotRow = row;
+        row += identity.count;
+    }
+    this->hotBuffer.swap(buffer);
+    this->hot = rows > 0 ? block : 0;
+
+    // older queries count less, so identities which stopped winning get demoted
+    for(unsigned int i = 0; i < this->identities.size(); i++)
+        this->identities[i].score *= 0.5;
+}
+
+int TieredGallery::hotIdentities() const
+{
+    int n = 0;
+    for(unsigned int i = 0; i < this->identities.size(); i++)
+        n += this->identities[i].hotRow >= 0;
+    return n;
+}
+
+size_t TieredGallery::hotBytes() const
+{
+    return this->hotBuffer.size();
+}
+
+long long TieredGallery::coldRows() const
+{
+    return this->coldRead;
+}
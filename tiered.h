@@ -0,0 +1,88 @@
+#ifndef TIERED_H
+#define TIERED_H
+
+#include <QFile>
+
+#include <string>
+#include <vector>
+
+#include "recognizer.h"
+
+using namespace std;
+
+/**
+ * gallery split into hot identities kept in RAM and cold identities read from memory mapped file
+ * KNN is exact: cold identity is skipped only when bound from its centroid and radius cannot beat top k
+ * statistics are updated by every query, so one instance serves one thread at a time
+ */
+class TieredGallery
+{
+public:
+    static const int REBALANCE_QUERIES = 1000; /** queries between promotions and demotions */
+    static const int ALIGN = 64; /** cache line, every hot row starts on one */
+
+    TieredGallery();
+    ~TieredGallery();
+    /**
+     * write gallery of model grouped by identity to file and map it, returns 0 on success
+     */
+    int build(const Recognizer &model, const string &path, size_t ramBudget);
+    /**
+     * unmap and remove gallery file
+     */
+    void close();
+    /**
+     * bytes of rows which may be held in RAM, applied at next rebalance
+     */
+    void setBudget(size_t bytes);
+    /**
+     * forget access statistics and demote all identities
+     */
+    void reset();
+    /**
+     * k nearest entries, same as Recognizer::nearest over whole gallery
+     */
+    void nearest(const Mat &target, unsigned int k, vector<Neighbour> &out);
+    /**
+     * keep identities with highest access score in RAM, as many as budget allows
+     */
+    void rebalance();
+    int hotIdentities() const;
+    size_t hotBytes() const;
+    /**
+     * rows read from mapped file since reset
+     */
+    long long coldRows() const;
+    /**
+     * how cold ranges which will be scanned are read ahead on this platform
+     */
+    static string readAhead();
+
+private:
+    struct Identity
+    {
+        string label;
+        unsigned int first; /** first row in file */
+        unsigned int count; /** */
+        float radius; /** max distance of its rows from centroid */
+        double score; /** decayed number of queries it won */
+        int hotRow; /** first row in hot block, -1 if cold */
+    };
+
+    vector<Identity> identities; /** */
+    Mat centroids; /** one row per identity, always in RAM */
+    vector<double> weights; /** weight of every file row */
+    int dims; /** */
+    QFile file; /** */
+    const float *cold; /** mapped rows of all identities */
+    vector<unsigned char> hotBuffer; /** */
+    float *hot; /** hot rows, aligned to ALIGN */
+    int stride; /** floats per hot row, rows are padded to ALIGN */
+    size_t budget; /** */
+    long long queries; /** */
+    long long coldRead; /** */
+
+    void advise(unsigned int first, unsigned int count) const;
+};
+
+#endif // TIERED_H